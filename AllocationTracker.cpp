@@ -0,0 +1,47 @@
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdlib.h>
+
+#include "Box2D/Box2D.h"
+
+using namespace std;
+
+// Every block starts with its size, padded so the memory handed out keeps
+// malloc's alignment
+static const size_t HeaderSize = 16;
+
+static atomic<size_t> allocatedBytes(0);
+static once_flag installed;
+
+static void* trackedAlloc(int32 size, void* callbackData) {
+	char* block = (char*)malloc(HeaderSize + size);
+	if (!block) {
+		return NULL;
+	}
+	*(size_t*)block = (size_t)size;
+	allocatedBytes += size;
+	return block + HeaderSize;
+}
+
+static void trackedFree(void* mem, void* callbackData) {
+	if (!mem) {
+		return;
+	}
+	char* block = (char*)mem - HeaderSize;
+	allocatedBytes -= *(size_t*)block;
+	free(block);
+}
+
+void installAllocationTracker() {
+	call_once(installed, [] {
+		if (b2GetNumAllocs() == 0) {
+			b2SetAllocFreeCallbacks(trackedAlloc, trackedFree, NULL);
+		}
+	});
+}
+
+size_t getTrackedAllocatedBytes() {
+	return allocatedBytes;
+}
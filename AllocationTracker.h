@@ -0,0 +1,9 @@
+#pragma once
+#include <stddef.h>
+
+// Counts the bytes LiquidFun has allocated through b2Alloc. LiquidFun only
+// takes allocator callbacks while nothing is allocated, so install before
+// the first b2World is created. The count covers every world in the
+// process, not just one CHOP's.
+void installAllocationTracker();
+size_t getTrackedAllocatedBytes();
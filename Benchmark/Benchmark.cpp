@@ -0,0 +1,449 @@
+// Headless benchmark for LiquidFunCHOP.
+// Loads the CHOP through CreateCHOPInstance with a mock host, cooks every
+// scene for a number of frames over a sweep of particle sizes, thread counts
+// and kernel sets, and writes the timings as JSON. With --report it also
+// records how the particle count and step time develop over a long run,
+// e.g. a --soak of many hours. With --set Outlifetime=1 and an Emitter
+// Lifetime it checks the lifetimes the emitted particles output, and exits
+// with 1 if they are off.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MockHost.h"
+
+using namespace std;
+
+extern "C" {
+	CHOP_CPlusPlusBase* CreateCHOPInstance(const OP_NodeInfo* info);
+	void DestroyCHOPInstance(CHOP_CPlusPlusBase* instance);
+}
+
+struct Options {
+	int frames = 600;
+	int warmup = 60;
+	double cookRate = 60;
+	// Frames per series sample, 0 for no series
+	int report = 0;
+	vector<int> scenes;
+	vector<string> sizes = { "0.02" };
+	vector<string> threads = { "1" };
+	vector<string> simd = { "Auto" };
+	vector<pair<string, string>> overrides;
+	string label;
+	string output;
+};
+
+// Averages over one --report window
+struct SeriesSample {
+	long long frame = 0;
+	int particles = 0;
+	double stepMean = 0;
+	int culledZone = 0;
+	int culledStuck = 0;
+};
+
+struct Result {
+	int scene = 0;
+	string size;
+	string threads;
+	string simd;
+	int particles = 0;
+	long long steps = 0;
+	double stepsPerSecond = 0;
+	double stepP50 = 0;
+	double stepP99 = 0;
+	double copyMean = 0;
+	double copyP99 = 0;
+	double cookP50 = 0;
+	double cookP99 = 0;
+	// Measured frames whose lifetime channels were off, see checkLifetimes()
+	int lifetimeErrors = 0;
+	vector<SeriesSample> series;
+};
+
+static vector<string> split(const string& text) {
+	vector<string> items;
+	stringstream stream(text);
+	string item;
+	while (getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static double percentile(vector<double> values, double p) {
+	if (values.empty()) {
+		return 0;
+	}
+	sort(values.begin(), values.end());
+	size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+	return values[min(i, values.size() - 1)];
+}
+
+static double mean(const vector<double>& values) {
+	double sum = 0;
+	for (double v : values) {
+		sum += v;
+	}
+	return values.empty() ? 0 : sum / values.size();
+}
+
+static void usage() {
+	fprintf(stderr,
+		"usage: LiquidFunBenchmark [options]\n"
+		"  --frames N        frames to measure per run (600)\n"
+		"  --warmup N        frames to cook before measuring (60)\n"
+		"  --rate HZ         cook rate of the mock timeline (60)\n"
+		"  --soak HOURS      measure this much simulated time instead of --frames\n"
+		"  --report N        add a particle count/step time sample every N frames;\n"
+		"                    the percentiles then cover the last window only\n"
+		"  --scenes LIST     scene indices, default all\n"
+		"  --sizes LIST      Particlesize values (0.02)\n"
+		"  --threads LIST    Threads values (1)\n"
+		"  --simd LIST       Simd menu items (Auto)\n"
+		"  --set NAME=VALUE  any other parameter, may be repeated\n"
+		"  --label TEXT      stored in the JSON, e.g. a commit hash\n"
+		"  --output FILE     JSON file, default stdout\n");
+}
+
+static bool parse(int argc, char** argv, Options& options) {
+	double soakHours = 0;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (i + 1 >= argc) {
+			return false;
+		}
+		string value = argv[++i];
+		if (arg == "--frames") {
+			options.frames = atoi(value.c_str());
+		} else if (arg == "--warmup") {
+			options.warmup = atoi(value.c_str());
+		} else if (arg == "--rate") {
+			options.cookRate = atof(value.c_str());
+		} else if (arg == "--soak") {
+			soakHours = atof(value.c_str());
+		} else if (arg == "--report") {
+			options.report = atoi(value.c_str());
+		} else if (arg == "--scenes") {
+			for (const string& s : split(value)) {
+				options.scenes.push_back(atoi(s.c_str()));
+			}
+		} else if (arg == "--sizes") {
+			options.sizes = split(value);
+		} else if (arg == "--threads") {
+			options.threads = split(value);
+		} else if (arg == "--simd") {
+			options.simd = split(value);
+		} else if (arg == "--set") {
+			size_t eq = value.find('=');
+			if (eq == string::npos) {
+				return false;
+			}
+			options.overrides.push_back(make_pair(value.substr(0, eq), value.substr(eq + 1)));
+		} else if (arg == "--label") {
+			options.label = value;
+		} else if (arg == "--output") {
+			options.output = value;
+		} else {
+			return false;
+		}
+	}
+	if (0 < soakHours) {
+		options.frames = (int)(soakHours * 3600 * options.cookRate);
+	}
+	return 0 < options.frames && 0 < options.cookRate && 0 <= options.report;
+}
+
+// Looks up an Info CHOP channel by name, 0 if the CHOP doesn't have it
+static float getInfoChannel(CHOP_CPlusPlusBase* chop, const char* name) {
+	int n = chop->getNumInfoCHOPChans(nullptr);
+	for (int i = 0; i < n; i++) {
+		MockString chanName;
+		OP_InfoCHOPChan chan;
+		chan.name = &chanName;
+		chan.value = 0;
+		chop->getInfoCHOPChan(i, &chan, nullptr);
+		if (chanName.value == name) {
+			return chan.value;
+		}
+	}
+	return 0;
+}
+
+// With the lifetime channels on and an Emitter Lifetime L, every live emitted
+// particle has to output a value in (0, L]. Returns false if none did while
+// the pool had live particles, or any value was over L.
+static bool checkLifetimes(CHOP_CPlusPlusBase* chop, const MockOutput& output,
+	const vector<int>& lifetimeChannels, double lifetime) {
+	if (lifetimeChannels.empty() || lifetime <= 0) {
+		return true;
+	}
+	bool emitted = false;
+	for (int c : lifetimeChannels) {
+		for (float value : output.getChannel(c)) {
+			if (value > lifetime + 1e-4) {
+				return false;
+			}
+			emitted = emitted || 0 < value;
+		}
+	}
+	return emitted || getInfoChannel(chop, "emitter_particles") == 0;
+}
+
+static Result run(const Options& options, const MockParameterManager& manager, const MockInputs& base) {
+	OP_NodeInfo nodeInfo;
+	memset(&nodeInfo, 0, sizeof(nodeInfo));
+	nodeInfo.opPath = "/benchmark/liquidfun1";
+	nodeInfo.pluginPath = "";
+
+	CHOP_CPlusPlusBase* chop = CreateCHOPInstance(&nodeInfo);
+	MockInputs inputs(base);
+	MockOutput output;
+	double deltaMS = 1000.0 / options.cookRate;
+	double lifetime = inputs.getParDouble("Emitterlifetime");
+	vector<int> lifetimeChannels;
+
+	Result result;
+	vector<double> stepTimes;
+	vector<double> copyTimes;
+	vector<double> cookTimes;
+	double totalStepTime = 0;
+	double windowStepTime = 0;
+	long long windowSteps = 0;
+
+	int frame = 0;
+	bool ready = false;
+	auto started = chrono::steady_clock::now();
+	while (frame < options.warmup + options.frames) {
+		inputs.advance(deltaMS);
+
+		auto cookStart = chrono::steady_clock::now();
+		CHOP_GeneralInfo generalInfo;
+		memset(&generalInfo, 0, sizeof(generalInfo));
+		chop->getGeneralInfo(&generalInfo, &inputs, nullptr);
+
+		CHOP_OutputInfo outputInfo;
+		memset(&outputInfo, 0, sizeof(outputInfo));
+		if (!chop->getOutputInfo(&outputInfo, &inputs, nullptr)) {
+			fprintf(stderr, "getOutputInfo() returned false\n");
+			break;
+		}
+		output.resize(outputInfo.numChannels, outputInfo.numSamples);
+		lifetimeChannels.clear();
+		for (int i = 0; i < outputInfo.numChannels; i++) {
+			MockString name;
+			chop->getChannelName(i, &name, &inputs, nullptr);
+			const string& n = name.value;
+			if (n == "lifetime" || (n.size() > 9 && n.compare(n.size() - 9, 9, "_lifetime") == 0)) {
+				lifetimeChannels.push_back(i);
+			}
+		}
+
+		CHOP_Output chopOutput = output.make(outputInfo.sampleRate);
+		chop->execute(&chopOutput, &inputs, nullptr);
+		auto cookEnd = chrono::steady_clock::now();
+
+		// The world is built in the background, the warmup starts once it's in
+		if (!ready) {
+			ready = getInfoChannel(chop, "building") == 0;
+			if (!ready && chrono::steady_clock::now() - started > chrono::seconds(60)) {
+				fprintf(stderr, "gave up waiting for the world to be built\n");
+				break;
+			}
+			if (!ready) {
+				this_thread::sleep_for(chrono::milliseconds(1));
+			}
+			continue;
+		}
+		if (frame++ < options.warmup) {
+			continue;
+		}
+		if (!checkLifetimes(chop, output, lifetimeChannels, lifetime)) {
+			result.lifetimeErrors++;
+		}
+
+		double cookTime = chrono::duration<double, milli>(cookEnd - cookStart).count();
+		double copyTime = getInfoChannel(chop, "copy_ms");
+		double stepTime = getInfoChannel(chop, "step_ms");
+		int substeps = (int)getInfoChannel(chop, "substeps");
+
+		if (0 < substeps) {
+			stepTimes.push_back(stepTime / substeps);
+		}
+		copyTimes.push_back(copyTime);
+		cookTimes.push_back(cookTime);
+		totalStepTime += stepTime;
+		result.steps += substeps;
+		result.particles = outputInfo.numSamples;
+
+		windowStepTime += stepTime;
+		windowSteps += substeps;
+		int measured = frame - options.warmup;
+		if (0 < options.report && measured % options.report == 0) {
+			SeriesSample sample;
+			sample.frame = measured;
+			sample.particles = (int)getInfoChannel(chop, "particles");
+			sample.stepMean = 0 < windowSteps ? windowStepTime / windowSteps : 0;
+			sample.culledZone = (int)getInfoChannel(chop, "culled_zone");
+			sample.culledStuck = (int)getInfoChannel(chop, "culled_stuck");
+			result.series.push_back(sample);
+			fprintf(stderr, "  %.2f h: %d particles, step %.3f ms, culled %d zone %d stuck\n",
+				measured / options.cookRate / 3600, sample.particles, sample.stepMean,
+				sample.culledZone, sample.culledStuck);
+
+			// Keeps a long soak from holding every frame's times
+			windowStepTime = 0;
+			windowSteps = 0;
+			if (frame < options.warmup + options.frames) {
+				stepTimes.clear();
+				copyTimes.clear();
+				cookTimes.clear();
+			}
+		}
+	}
+
+	DestroyCHOPInstance(chop);
+
+	result.stepsPerSecond = 0 < totalStepTime ? result.steps / (totalStepTime / 1000.0) : 0;
+	result.stepP50 = percentile(stepTimes, 0.5);
+	result.stepP99 = percentile(stepTimes, 0.99);
+	result.copyMean = mean(copyTimes);
+	result.copyP99 = percentile(copyTimes, 0.99);
+	result.cookP50 = percentile(cookTimes, 0.5);
+	result.cookP99 = percentile(cookTimes, 0.99);
+	return result;
+}
+
+static string escape(const string& text) {
+	string out;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+		}
+		out += c;
+	}
+	return out;
+}
+
+static void writeJson(FILE* file, const Options& options, const vector<Result>& results) {
+	fprintf(file, "{\n");
+	fprintf(file, "  \"label\": \"%s\",\n", escape(options.label).c_str());
+	fprintf(file, "  \"frames\": %d,\n", options.frames);
+	fprintf(file, "  \"warmup\": %d,\n", options.warmup);
+	fprintf(file, "  \"cook_rate\": %g,\n", options.cookRate);
+	fprintf(file, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& r = results[i];
+		fprintf(file, "    {\"scene\": %d, \"particle_size\": %s, \"threads\": %s, \"simd\": \"%s\", "
+			"\"particles\": %d, \"steps\": %lld, \"steps_per_sec\": %.2f, "
+			"\"step_ms_p50\": %.4f, \"step_ms_p99\": %.4f, "
+			"\"copy_ms_mean\": %.4f, \"copy_ms_p99\": %.4f, "
+			"\"cook_ms_p50\": %.4f, \"cook_ms_p99\": %.4f",
+			r.scene, r.size.c_str(), r.threads.c_str(), escape(r.simd).c_str(),
+			r.particles, r.steps, r.stepsPerSecond,
+			r.stepP50, r.stepP99,
+			r.copyMean, r.copyP99,
+			r.cookP50, r.cookP99);
+		if (!r.series.empty()) {
+			// [frame, particles, step_ms_mean, culled_zone, culled_stuck]
+			fprintf(file, ", \"series\": [");
+			for (size_t j = 0; j < r.series.size(); j++) {
+				const SeriesSample& t = r.series[j];
+				fprintf(file, "%s[%lld, %d, %.4f, %d, %d]", j ? ", " : "",
+					t.frame, t.particles, t.stepMean, t.culledZone, t.culledStuck);
+			}
+			fprintf(file, "]");
+		}
+		fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parse(argc, argv, options)) {
+		usage();
+		return 1;
+	}
+
+	// Collect the parameters and their defaults the way TouchDesigner would
+	OP_NodeInfo nodeInfo;
+	memset(&nodeInfo, 0, sizeof(nodeInfo));
+	nodeInfo.opPath = "/benchmark/setup";
+	nodeInfo.pluginPath = "";
+	CHOP_CPlusPlusBase* chop = CreateCHOPInstance(&nodeInfo);
+	MockParameterManager manager;
+	chop->setupParameters(&manager, nullptr);
+	DestroyCHOPInstance(chop);
+
+	MockInputs base(manager);
+	for (const auto& o : options.overrides) {
+		if (!base.set(o.first, o.second)) {
+			fprintf(stderr, "unknown parameter %s\n", o.first.c_str());
+			return 1;
+		}
+	}
+
+	if (options.scenes.empty()) {
+		auto it = manager.parameters.find("Sceneindex");
+		int numScenes = it != manager.parameters.end() ? (int)it->second.maxSlider + 1 : 1;
+		for (int i = 0; i < numScenes; i++) {
+			options.scenes.push_back(i);
+		}
+	}
+
+	vector<Result> results;
+	bool failed = false;
+	for (int scene : options.scenes) {
+		for (const string& size : options.sizes) {
+			for (const string& threads : options.threads) {
+				for (const string& simd : options.simd) {
+					MockInputs inputs(base);
+					inputs.set("Sceneindex", to_string(scene));
+					inputs.set("Particlesize", size);
+					inputs.set("Threads", threads);
+					inputs.set("Simd", simd);
+
+					Result result = run(options, manager, inputs);
+					result.scene = scene;
+					result.size = size;
+					result.threads = threads;
+					result.simd = simd;
+					results.push_back(result);
+
+					fprintf(stderr, "scene %d size %s threads %s simd %s: %d particles, %.1f steps/s, p50 %.3f ms, p99 %.3f ms, copy %.3f ms\n",
+						scene, size.c_str(), threads.c_str(), simd.c_str(), result.particles,
+						result.stepsPerSecond, result.stepP50, result.stepP99, result.copyMean);
+					if (result.lifetimeErrors) {
+						fprintf(stderr, "  %d frames output emitted lifetimes outside (0, Emitterlifetime]\n",
+							result.lifetimeErrors);
+						failed = true;
+					}
+				}
+			}
+		}
+	}
+
+	FILE* file = stdout;
+	if (!options.output.empty()) {
+		file = fopen(options.output.c_str(), "w");
+		if (!file) {
+			fprintf(stderr, "can't write %s\n", options.output.c_str());
+			return 1;
+		}
+	}
+	writeJson(file, options, results);
+	if (file != stdout) {
+		fclose(file);
+	}
+	return failed ? 1 : 0;
+}
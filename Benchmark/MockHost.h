@@ -0,0 +1,289 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CHOP_CPlusPlusBase.h"
+
+using namespace std;
+
+// Just enough of TouchDesigner to load a CHOP, set its parameters and cook
+// it without the application.
+
+class MockString : public OP_String {
+public:
+	virtual void setString(const char* val) override { value = val ? val : ""; }
+
+	string value;
+};
+
+struct MockParameter {
+	double values[4] = { 0, 0, 0, 0 };
+	string text;
+	vector<string> menuNames;
+	double minSlider = 0;
+	double maxSlider = 1;
+};
+
+// Records the parameters a CHOP appends, with their defaults
+class MockParameterManager : public OP_ParameterManager {
+public:
+	map<string, MockParameter> parameters;
+	vector<string> order;
+
+	virtual OP_ParAppendResult appendFloat(const OP_NumericParameter& np, int32_t size = 1) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendInt(const OP_NumericParameter& np, int32_t size = 1) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendXY(const OP_NumericParameter& np) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendXYZ(const OP_NumericParameter& np) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendUV(const OP_NumericParameter& np) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendUVW(const OP_NumericParameter& np) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendRGB(const OP_NumericParameter& np) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendRGBA(const OP_NumericParameter& np) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendToggle(const OP_NumericParameter& np) override { return appendNumeric(np); }
+	virtual OP_ParAppendResult appendPulse(const OP_NumericParameter& np) override { return appendNumeric(np); }
+
+	virtual OP_ParAppendResult appendString(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendFile(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendFolder(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendDAT(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendCHOP(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendTOP(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendObject(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendSOP(const OP_StringParameter& sp) override { return appendText(sp); }
+	virtual OP_ParAppendResult appendPython(const OP_StringParameter& sp) override { return appendText(sp); }
+
+	virtual OP_ParAppendResult appendMenu(const OP_StringParameter& sp, int32_t nitems, const char** names, const char** labels) override {
+		OP_ParAppendResult res = appendText(sp);
+		if (res == OP_ParAppendResult::Success) {
+			MockParameter& p = parameters[sp.name];
+			for (int i = 0; i < nitems; i++) {
+				p.menuNames.push_back(names[i]);
+				if (p.text == names[i]) {
+					p.values[0] = i;
+				}
+			}
+		}
+		return res;
+	}
+
+	virtual OP_ParAppendResult appendStringMenu(const OP_StringParameter& sp, int32_t nitems, const char** names, const char** labels) override {
+		return appendMenu(sp, nitems, names, labels);
+	}
+
+private:
+	OP_ParAppendResult appendNumeric(const OP_NumericParameter& np) {
+		if (!np.name || parameters.count(np.name)) {
+			return OP_ParAppendResult::InvalidName;
+		}
+		MockParameter& p = parameters[np.name];
+		for (int i = 0; i < 4; i++) {
+			p.values[i] = np.defaultValues[i];
+		}
+		p.minSlider = np.minSliders[0];
+		p.maxSlider = np.maxSliders[0];
+		order.push_back(np.name);
+		return OP_ParAppendResult::Success;
+	}
+
+	OP_ParAppendResult appendText(const OP_StringParameter& sp) {
+		if (!sp.name || parameters.count(sp.name)) {
+			return OP_ParAppendResult::InvalidName;
+		}
+		parameters[sp.name].text = sp.defaultValue ? sp.defaultValue : "";
+		order.push_back(sp.name);
+		return OP_ParAppendResult::Success;
+	}
+};
+
+// Parameter values and timing for one cook. Nothing is wired into the inputs.
+class MockInputs : public OP_Inputs {
+public:
+	MockInputs(const MockParameterManager& manager) : parameters(manager.parameters) {
+		memset(&timeInfo, 0, sizeof(timeInfo));
+		timeInfo.rate = 60;
+		timeInfo.rootRate = 60;
+	}
+
+	map<string, MockParameter> parameters;
+	OP_TimeInfo timeInfo;
+
+	// Sets a parameter from text: a number, comma separated numbers, or a
+	// menu item name. Returns false for unknown parameters.
+	bool set(const string& name, const string& value) {
+		auto it = parameters.find(name);
+		if (it == parameters.end()) {
+			return false;
+		}
+		MockParameter& p = it->second;
+		p.text = value;
+		for (int i = 0; i < (int)p.menuNames.size(); i++) {
+			if (p.menuNames[i] == value) {
+				p.values[0] = i;
+				return true;
+			}
+		}
+		const char* s = value.c_str();
+		for (int i = 0; i < 4 && *s; i++) {
+			char* end = NULL;
+			double v = strtod(s, &end);
+			if (end == s) {
+				break;
+			}
+			p.values[i] = v;
+			s = *end == ',' ? end + 1 : end;
+		}
+		return true;
+	}
+
+	// Advances the timeline by one frame of 'deltaMS'
+	void advance(double deltaMS) {
+		timeInfo.absFrame++;
+		timeInfo.frame += 1;
+		timeInfo.rootFrame += 1;
+		timeInfo.deltaFrames = 1;
+		timeInfo.deltaMS = deltaMS;
+		timeInfo.rate = 1000.0 / deltaMS;
+		timeInfo.rootRate = timeInfo.rate;
+	}
+
+	virtual int32_t getNumInputs() const override { return 0; }
+	virtual const OP_TOPInput* getInputTOP(int32_t index) const override { return nullptr; }
+	virtual const OP_CHOPInput* getInputCHOP(int32_t index) const override { return nullptr; }
+
+	virtual const OP_DATInput* getParDAT(const char* name) const override { return nullptr; }
+	virtual const OP_TOPInput* getParTOP(const char* name) const override { return nullptr; }
+	virtual const OP_CHOPInput* getParCHOP(const char* name) const override { return nullptr; }
+	virtual const OP_ObjectInput* getParObject(const char* name) const override { return nullptr; }
+
+	virtual double getParDouble(const char* name, int32_t index = 0) const override {
+		const MockParameter* p = find(name);
+		return p && 0 <= index && index < 4 ? p->values[index] : 0.0;
+	}
+	virtual bool getParDouble2(const char* name, double& v0, double& v1) const override {
+		const MockParameter* p = find(name);
+		if (!p) {
+			return false;
+		}
+		v0 = p->values[0];
+		v1 = p->values[1];
+		return true;
+	}
+	virtual bool getParDouble3(const char* name, double& v0, double& v1, double& v2) const override {
+		const MockParameter* p = find(name);
+		if (!p) {
+			return false;
+		}
+		v0 = p->values[0];
+		v1 = p->values[1];
+		v2 = p->values[2];
+		return true;
+	}
+	virtual bool getParDouble4(const char* name, double& v0, double& v1, double& v2, double& v3) const override {
+		const MockParameter* p = find(name);
+		if (!p) {
+			return false;
+		}
+		v0 = p->values[0];
+		v1 = p->values[1];
+		v2 = p->values[2];
+		v3 = p->values[3];
+		return true;
+	}
+
+	virtual int32_t getParInt(const char* name, int32_t index = 0) const override {
+		return (int32_t)lround(getParDouble(name, index));
+	}
+	virtual bool getParInt2(const char* name, int32_t& v0, int32_t& v1) const override {
+		double d0, d1;
+		if (!getParDouble2(name, d0, d1)) {
+			return false;
+		}
+		v0 = (int32_t)lround(d0);
+		v1 = (int32_t)lround(d1);
+		return true;
+	}
+	virtual bool getParInt3(const char* name, int32_t& v0, int32_t& v1, int32_t& v2) const override {
+		double d0, d1, d2;
+		if (!getParDouble3(name, d0, d1, d2)) {
+			return false;
+		}
+		v0 = (int32_t)lround(d0);
+		v1 = (int32_t)lround(d1);
+		v2 = (int32_t)lround(d2);
+		return true;
+	}
+	virtual bool getParInt4(const char* name, int32_t& v0, int32_t& v1, int32_t& v2, int32_t& v3) const override {
+		double d0, d1, d2, d3;
+		if (!getParDouble4(name, d0, d1, d2, d3)) {
+			return false;
+		}
+		v0 = (int32_t)lround(d0);
+		v1 = (int32_t)lround(d1);
+		v2 = (int32_t)lround(d2);
+		v3 = (int32_t)lround(d3);
+		return true;
+	}
+
+	virtual const char* getParString(const char* name) const override {
+		const MockParameter* p = find(name);
+		return p ? p->text.c_str() : "";
+	}
+	virtual const char* getParFilePath(const char* name) const override { return getParString(name); }
+
+	virtual bool getRelativeTransform(const char* from_name, const char* to_name, double matrix[4][4]) const override { return false; }
+	virtual void enablePar(const char* name, bool onoff) const override {}
+
+	virtual const OP_DATInput* getDAT(const char* path) const override { return nullptr; }
+	virtual const OP_TOPInput* getTOP(const char* path) const override { return nullptr; }
+	virtual const OP_CHOPInput* getCHOP(const char* path) const override { return nullptr; }
+	virtual const OP_ObjectInput* getObject(const char* path) const override { return nullptr; }
+
+	virtual void* getTOPDataInCPUMemory(const OP_TOPInput* top, const OP_TOPInputDownloadOptions* options) const override { return nullptr; }
+
+	virtual const OP_SOPInput* getParSOP(const char* name) const override { return nullptr; }
+	virtual const OP_SOPInput* getInputSOP(int32_t index) const override { return nullptr; }
+	virtual const OP_SOPInput* getSOP(const char* path) const override { return nullptr; }
+	virtual const OP_DATInput* getInputDAT(int32_t index) const override { return nullptr; }
+
+	virtual PyObject* getParPython(const char* name) const override { return nullptr; }
+
+	virtual const OP_TimeInfo* getTimeInfo() const override { return &timeInfo; }
+
+private:
+	const MockParameter* find(const char* name) const {
+		auto it = parameters.find(name);
+		return it != parameters.end() ? &it->second : nullptr;
+	}
+};
+
+// Channel storage for one cook, sized the way TouchDesigner would
+class MockOutput {
+public:
+	void resize(int numChannels, int numSamples) {
+		_data.resize(numChannels);
+		_channels.resize(numChannels);
+		_names.assign(numChannels, "");
+		for (int i = 0; i < numChannels; i++) {
+			_data[i].resize(numSamples);
+			_channels[i] = _data[i].data();
+		}
+		_numChannels = numChannels;
+		_numSamples = numSamples;
+	}
+
+	CHOP_Output make(float sampleRate) {
+		return CHOP_Output(_numChannels, _numSamples, sampleRate, 0, _channels.data(), _names.data());
+	}
+
+	const vector<float>& getChannel(int index) const { return _data[index]; }
+
+private:
+	vector<vector<float>> _data;
+	vector<float*> _channels;
+	vector<const char*> _names;
+	int _numChannels = 0;
+	int _numSamples = 0;
+};
@@ -0,0 +1,6 @@
+#pragma once
+// CPlusPlus_Common.h includes this on every platform that isn't Windows.
+// The benchmark never touches GL, it only needs the typedefs.
+typedef unsigned int GLuint;
+typedef unsigned int GLenum;
+typedef int GLint;
@@ -0,0 +1,202 @@
+#include "ColliderGeometry.h"
+
+#include <map>
+#include <utility>
+
+// Twice the signed area of the triangle o, a, b; positive if counter-clockwise
+static float cross(const b2Vec2& o, const b2Vec2& a, const b2Vec2& b) {
+	return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static float distanceSquared(const b2Vec2& a, const b2Vec2& b) {
+	float dx = a.x - b.x;
+	float dy = a.y - b.y;
+	return dx * dx + dy * dy;
+}
+
+static float signedArea(const vector<b2Vec2>& polygon) {
+	float area = 0;
+	size_t n = polygon.size();
+	for (size_t i = 0, j = n - 1; i < n; j = i++) {
+		area += polygon[j].x * polygon[i].y - polygon[i].x * polygon[j].y;
+	}
+	return area * 0.5f;
+}
+
+static bool insideTriangle(const b2Vec2& p, const b2Vec2& a, const b2Vec2& b, const b2Vec2& c) {
+	return cross(a, b, p) >= 0 && cross(b, c, p) >= 0 && cross(c, a, p) >= 0;
+}
+
+static bool isConvex(const vector<b2Vec2>& points, const vector<int>& polygon) {
+	size_t n = polygon.size();
+	for (size_t i = 0; i < n; i++) {
+		const b2Vec2& a = points[polygon[(i + n - 1) % n]];
+		const b2Vec2& b = points[polygon[i]];
+		const b2Vec2& c = points[polygon[(i + 1) % n]];
+		if (cross(a, b, c) < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Triangulates the counter-clockwise polygon by cutting off one ear at a time
+static void clipEars(const vector<b2Vec2>& points, vector<vector<int>>& triangles) {
+	vector<int> remaining;
+	for (int i = 0; i < (int)points.size(); i++) {
+		remaining.push_back(i);
+	}
+
+	int i = 0;
+	int misses = 0;
+	while (remaining.size() > 3) {
+		int m = (int)remaining.size();
+		i %= m;
+		int prev = remaining[(i + m - 1) % m];
+		int cur = remaining[i];
+		int next = remaining[(i + 1) % m];
+
+		bool ear = cross(points[prev], points[cur], points[next]) > 0;
+		for (int k = 0; ear && k < m; k++) {
+			int other = remaining[k];
+			if (other != prev && other != cur && other != next &&
+				insideTriangle(points[other], points[prev], points[cur], points[next])) {
+				ear = false;
+			}
+		}
+		// A self-intersecting outline can run out of ears, cut anyway
+		if (ear || misses >= m) {
+			triangles.push_back({ prev, cur, next });
+			remaining.erase(remaining.begin() + i);
+			misses = 0;
+		} else {
+			i++;
+			misses++;
+		}
+	}
+	triangles.push_back(remaining);
+}
+
+// Joins the pieces p and q along p's edge a->b, which is b->a in q
+static vector<int> joinPieces(const vector<int>& p, const vector<int>& q, int a, int b) {
+	size_t i = 0;
+	while (p[i] != a) {
+		i++;
+	}
+	size_t j = 0;
+	while (q[j] != b) {
+		j++;
+	}
+	vector<int> joined;
+	for (size_t k = 0; k < p.size(); k++) {
+		joined.push_back(p[(i + 1 + k) % p.size()]);
+	}
+	for (size_t k = 2; k < q.size(); k++) {
+		joined.push_back(q[(j + k) % q.size()]);
+	}
+	return joined;
+}
+
+void decomposePolygon(const vector<b2Vec2>& polygon, vector<vector<b2Vec2>>& pieces) {
+	pieces.clear();
+	if (polygon.size() < 3) {
+		return;
+	}
+	vector<b2Vec2> points = polygon;
+	if (signedArea(points) < 0) {
+		points.assign(polygon.rbegin(), polygon.rend());
+	}
+
+	vector<vector<int>> parts;
+	clipEars(points, parts);
+
+	// Merge across shared edges until no neighbours make a convex piece.
+	// Pieces merged in a pass are left alone until the next one, so the
+	// edge map stays valid.
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		map<pair<int, int>, int> edges;
+		for (int p = 0; p < (int)parts.size(); p++) {
+			const vector<int>& part = parts[p];
+			for (size_t k = 0; k < part.size(); k++) {
+				edges[make_pair(part[k], part[(k + 1) % part.size()])] = p;
+			}
+		}
+
+		vector<bool> touched(parts.size(), false);
+		for (int p = 0; p < (int)parts.size(); p++) {
+			if (touched[p] || parts[p].empty()) {
+				continue;
+			}
+			const vector<int>& part = parts[p];
+			for (size_t k = 0; k < part.size(); k++) {
+				int a = part[k];
+				int b = part[(k + 1) % part.size()];
+				auto it = edges.find(make_pair(b, a));
+				if (it == edges.end()) {
+					continue;
+				}
+				int q = it->second;
+				if (q == p || touched[q] || parts[q].empty() ||
+					part.size() + parts[q].size() - 2 > b2_maxPolygonVertices) {
+					continue;
+				}
+				vector<int> joined = joinPieces(part, parts[q], a, b);
+				if (isConvex(points, joined)) {
+					parts[p] = joined;
+					parts[q].clear();
+					touched[p] = touched[q] = true;
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+
+	for (const vector<int>& part : parts) {
+		if (part.empty()) {
+			continue;
+		}
+		vector<b2Vec2> piece;
+		for (int index : part) {
+			piece.push_back(points[index]);
+		}
+		pieces.push_back(piece);
+	}
+}
+
+void addColliderOutline(ColliderGeometry& geometry, const b2Vec2* outline, int count, ColliderMode mode) {
+	const float minDistanceSquared = b2_linearSlop * b2_linearSlop;
+	vector<b2Vec2> points;
+	for (int i = 0; i < count; i++) {
+		if (points.empty() || distanceSquared(points.back(), outline[i]) > minDistanceSquared) {
+			points.push_back(outline[i]);
+		}
+	}
+	while (points.size() > 1 && distanceSquared(points.back(), points.front()) <= minDistanceSquared) {
+		points.pop_back();
+	}
+	if (points.size() < 3) {
+		return;
+	}
+
+	if (mode == ColliderMode::Outline) {
+		ColliderPart part = { true, (int)geometry.vertices.size(), (int)points.size() };
+		geometry.vertices.insert(geometry.vertices.end(), points.begin(), points.end());
+		geometry.parts.push_back(part);
+		return;
+	}
+
+	vector<vector<b2Vec2>> pieces;
+	decomposePolygon(points, pieces);
+	for (const vector<b2Vec2>& piece : pieces) {
+		// b2PolygonShape can't take slivers
+		if (signedArea(piece) <= minDistanceSquared) {
+			continue;
+		}
+		ColliderPart part = { false, (int)geometry.vertices.size(), (int)piece.size() };
+		geometry.vertices.insert(geometry.vertices.end(), piece.begin(), piece.end());
+		geometry.parts.push_back(part);
+	}
+}
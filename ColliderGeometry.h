@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+#include "Box2D/Box2D.h"
+
+using namespace std;
+
+// How the outlines of a collider SOP become fixtures
+enum class ColliderMode : int32_t {
+	// Each closed outline is a chain loop, particles stay on either side
+	Outline,
+	// Each closed outline is filled, split into convex polygons
+	Solid,
+};
+
+// A run of vertices in ColliderGeometry::vertices that makes one fixture
+struct ColliderPart {
+	// Chain loop, or a convex polygon of at most b2_maxPolygonVertices
+	bool chain;
+	int begin;
+	int count;
+};
+
+// Fixtures of a collider in the body's local space. Building one can be
+// expensive, so they are shared and never changed once built.
+struct ColliderGeometry {
+	uint64_t hash = 0;
+	vector<b2Vec2> vertices;
+	vector<ColliderPart> parts;
+};
+
+// Adds the fixtures for one closed outline. Vertices closer than
+// b2_linearSlop are merged, outlines with less than 3 left are skipped.
+void addColliderOutline(ColliderGeometry& geometry, const b2Vec2* outline, int count, ColliderMode mode);
+
+// Splits a simple polygon in either winding into counter-clockwise convex
+// pieces of at most b2_maxPolygonVertices: ear clipping, then merging
+// neighbouring pieces as long as they stay convex (Hertel-Mehlhorn).
+void decomposePolygon(const vector<b2Vec2>& polygon, vector<vector<b2Vec2>>& pieces);
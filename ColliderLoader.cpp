@@ -0,0 +1,157 @@
+#include "ColliderLoader.h"
+
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+
+// Shapes kept around, so switching between a few SOP states doesn't
+// decompose them again
+static const size_t MaxCachedColliders = 32;
+
+static mutex cacheMutex;
+static map<uint64_t, shared_ptr<const ColliderGeometry>> cache;
+static deque<uint64_t> cacheOrder;
+
+static shared_ptr<const ColliderGeometry> findCollider(uint64_t hash) {
+	lock_guard<mutex> lock(cacheMutex);
+	auto it = cache.find(hash);
+	return it != cache.end() ? it->second : NULL;
+}
+
+static void addCollider(const shared_ptr<const ColliderGeometry>& geometry) {
+	lock_guard<mutex> lock(cacheMutex);
+	if (cache.count(geometry->hash)) {
+		return;
+	}
+	if (cacheOrder.size() >= MaxCachedColliders) {
+		cache.erase(cacheOrder.front());
+		cacheOrder.pop_front();
+	}
+	cache[geometry->hash] = geometry;
+	cacheOrder.push_back(geometry->hash);
+}
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Finds the rotation and translation that move 'from' onto 'to' (a 2D
+// Kabsch fit). Returns false if the points don't match up to rounding, so
+// the shape itself has changed.
+static bool fitRigid(const vector<b2Vec2>& from, const vector<b2Vec2>& to, float& x, float& y, float& angle) {
+	size_t n = from.size();
+	if (n == 0 || n != to.size()) {
+		return false;
+	}
+	double fromX = 0, fromY = 0, toX = 0, toY = 0;
+	for (size_t i = 0; i < n; i++) {
+		fromX += from[i].x;
+		fromY += from[i].y;
+		toX += to[i].x;
+		toY += to[i].y;
+	}
+	fromX /= n;
+	fromY /= n;
+	toX /= n;
+	toY /= n;
+
+	double s = 0, c = 0, extent = 0;
+	for (size_t i = 0; i < n; i++) {
+		double rx = from[i].x - fromX, ry = from[i].y - fromY;
+		double tx = to[i].x - toX, ty = to[i].y - toY;
+		c += rx * tx + ry * ty;
+		s += rx * ty - ry * tx;
+		extent = fmax(extent, rx * rx + ry * ry);
+	}
+	double a = atan2(s, c);
+	double cosA = cos(a), sinA = sin(a);
+
+	double tolerance = 1e-4 * (1 + sqrt(extent));
+	for (size_t i = 0; i < n; i++) {
+		double rx = from[i].x - fromX, ry = from[i].y - fromY;
+		double dx = toX + cosA * rx - sinA * ry - to[i].x;
+		double dy = toY + sinA * rx + cosA * ry - to[i].y;
+		if (dx * dx + dy * dy > tolerance * tolerance) {
+			return false;
+		}
+	}
+
+	x = (float)(toX - (cosA * fromX - sinA * fromY));
+	y = (float)(toY - (sinA * fromX + cosA * fromY));
+	angle = (float)a;
+	return true;
+}
+
+void ColliderLoader::update(const OP_Inputs* inputs, SimulationParameters& params) {
+	const OP_SOPInput* sop = inputs->getParSOP("Collidersop");
+	ColliderMode mode = (ColliderMode)inputs->getParInt("Collidermode");
+	if (!sop) {
+		_sopId = 0;
+		_sopCooks = -1;
+		_topology = 0;
+		_reference.clear();
+		_geometry = NULL;
+	} else if (sop->opId != _sopId || sop->totalCooks != _sopCooks || mode != _mode) {
+		_sopId = sop->opId;
+		_sopCooks = sop->totalCooks;
+		_mode = mode;
+		load(sop, mode);
+	}
+
+	params.collider = _geometry;
+	params.colliderX = _x;
+	params.colliderY = _y;
+	params.colliderAngle = _angle;
+}
+
+void ColliderLoader::load(const OP_SOPInput* sop, ColliderMode mode) {
+	int numPoints = sop->getNumPoints();
+	const Position* positions = sop->getPointPositions();
+	_points.resize(numPoints);
+	for (int i = 0; i < numPoints; i++) {
+		_points[i].Set(positions[i].x, positions[i].y);
+	}
+
+	uint64_t topology = hashBytes(14695981039346656037ULL, &mode, sizeof(mode));
+	int numPrimitives = sop->getNumPrimitives();
+	for (int i = 0; i < numPrimitives; i++) {
+		SOP_PrimitiveInfo primitive = sop->getPrimitive(i);
+		topology = hashBytes(topology, &primitive.numVertices, sizeof(primitive.numVertices));
+		topology = hashBytes(topology, primitive.pointIndices, primitive.numVertices * sizeof(int32_t));
+	}
+
+	// Only moved: keep the geometry and the points it was built from
+	if (_geometry && topology == _topology && fitRigid(_reference, _points, _x, _y, _angle)) {
+		return;
+	}
+
+	uint64_t hash = hashBytes(topology, _points.data(), _points.size() * sizeof(b2Vec2));
+	_geometry = findCollider(hash);
+	if (!_geometry) {
+		shared_ptr<ColliderGeometry> geometry(new ColliderGeometry());
+		geometry->hash = hash;
+		vector<b2Vec2> outline;
+		for (int i = 0; i < numPrimitives; i++) {
+			SOP_PrimitiveInfo primitive = sop->getPrimitive(i);
+			outline.clear();
+			for (int v = 0; v < primitive.numVertices; v++) {
+				outline.push_back(_points[primitive.pointIndices[v]]);
+			}
+			addColliderOutline(*geometry, outline.data(), (int)outline.size(), mode);
+		}
+		addCollider(geometry);
+		_geometry = geometry;
+	}
+	_topology = topology;
+	_reference = _points;
+	_x = 0;
+	_y = 0;
+	_angle = 0;
+}
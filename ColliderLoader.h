@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+#include "ColliderGeometry.h"
+#include "SimulationParameters.h"
+
+using namespace std;
+
+// Follows the Collidersop parameter of one CHOP. The SOP is only read again
+// when it has cooked. If its points have just been moved rigidly, only the
+// collider's transform changes; otherwise the geometry comes from a small
+// process-wide cache keyed on the point data, and is only built (and
+// decomposed) on a miss.
+class ColliderLoader {
+public:
+	// Sets the collider and its transform in params
+	void update(const OP_Inputs* inputs, SimulationParameters& params);
+
+private:
+	void load(const OP_SOPInput* sop, ColliderMode mode);
+
+	uint32_t _sopId = 0;
+	int64_t _sopCooks = -1;
+	ColliderMode _mode = ColliderMode::Outline;
+
+	// Hash of the primitives and mode, and the points the geometry was
+	// built from
+	uint64_t _topology = 0;
+	vector<b2Vec2> _reference;
+	vector<b2Vec2> _points;
+
+	shared_ptr<const ColliderGeometry> _geometry;
+	float _x = 0;
+	float _y = 0;
+	float _angle = 0;
+};
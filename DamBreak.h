@@ -4,7 +4,11 @@
 
 class DamBreak : public SceneBase {
 public:
-	virtual void setup(b2World* world, b2ParticleSystem* particleSystem, const OP_Inputs* inputs) override {
+	virtual std::shared_ptr<SceneBase> create() const override {
+		return std::make_shared<DamBreak>();
+	}
+
+	virtual void setup(b2World* world, b2ParticleSystem* particleSystem, const SimulationParameters& params) override {
 		b2BodyDef bd;
 		b2Body* ground = world->CreateBody(&bd);
 
@@ -21,7 +25,7 @@ public:
 		b2PolygonShape polygon;
 		polygon.SetAsBox(0.8f, 1.0f, b2Vec2(-1.2f, -1.01f), 0);
 		b2ParticleGroupDef pd;
-		int particleType = inputs->getParInt("Particletype");
+		int particleType = params.particleType;
 		if (particleType == 0) {
 			pd.groupFlags = b2_solidParticleGroup;
 		} else if (particleType == 1) {
@@ -0,0 +1,179 @@
+#pragma once
+#include <cmath>
+#include <memory>
+#include <string.h>
+#include <vector>
+
+#include "SceneBase.h"
+#include "SceneImage.h"
+
+// Scene built from a compiled SceneImage instead of code
+class DataScene : public SceneBase {
+public:
+	DataScene(std::shared_ptr<const SceneImage> image) : _image(image) {}
+
+	virtual std::shared_ptr<SceneBase> create() const override {
+		return std::make_shared<DataScene>(_image);
+	}
+
+	virtual void setup(b2World* world, b2ParticleSystem* particleSystem, const SimulationParameters& params) override {
+		const SceneImage& image = *_image;
+
+		std::vector<b2Body*> bodies;
+		for (const SceneBody& b : image.bodies) {
+			b2BodyDef bd;
+			bd.type = (b2BodyType)b.type;
+			bd.position.Set(b.x, b.y);
+			bd.angle = b.angle;
+			bd.allowSleep = b.allowSleep != 0;
+			b2Body* body = world->CreateBody(&bd);
+			bodies.push_back(body);
+
+			for (int i = b.firstFixture; i < b.firstFixture + b.fixtureCount; i++) {
+				const SceneFixture& f = image.fixtures[i];
+				Shapes shapes;
+				b2FixtureDef fd;
+				fd.shape = makeShape(f.shape, shapes);
+				fd.density = f.density;
+				fd.friction = f.friction;
+				fd.restitution = f.restitution;
+				body->CreateFixture(&fd);
+			}
+		}
+
+		_joints.clear();
+		for (const SceneJoint& j : image.joints) {
+			b2Joint* joint = NULL;
+			if (j.type == SceneJointType::Revolute) {
+				b2RevoluteJointDef jd;
+				setJointDef(jd, j, bodies);
+				jd.referenceAngle = j.referenceAngle;
+				jd.enableLimit = j.enableLimit != 0;
+				jd.lowerAngle = j.lower;
+				jd.upperAngle = j.upper;
+				jd.enableMotor = j.enableMotor != 0;
+				jd.motorSpeed = j.motorSpeed;
+				jd.maxMotorTorque = j.maxMotorForce;
+				joint = world->CreateJoint(&jd);
+			} else if (j.type == SceneJointType::Prismatic) {
+				b2PrismaticJointDef jd;
+				setJointDef(jd, j, bodies);
+				jd.localAxisA.Set(j.axisX, j.axisY);
+				jd.localAxisA.Normalize();
+				jd.referenceAngle = j.referenceAngle;
+				jd.enableLimit = j.enableLimit != 0;
+				jd.lowerTranslation = j.lower;
+				jd.upperTranslation = j.upper;
+				jd.enableMotor = j.enableMotor != 0;
+				jd.motorSpeed = j.motorSpeed;
+				jd.maxMotorForce = j.maxMotorForce;
+				joint = world->CreateJoint(&jd);
+			} else {
+				b2WeldJointDef jd;
+				setJointDef(jd, j, bodies);
+				jd.referenceAngle = j.referenceAngle;
+				joint = world->CreateJoint(&jd);
+			}
+			_joints.push_back(joint);
+		}
+
+		for (const SceneParticleGroup& g : image.groups) {
+			Shapes shapes;
+			b2ParticleGroupDef pd;
+			pd.shape = makeShape(g.shape, shapes);
+			if (g.hasFlags) {
+				pd.flags = g.flags;
+				pd.groupFlags = g.groupFlags;
+			} else if (params.particleType == 0) {
+				pd.groupFlags = b2_solidParticleGroup;
+			} else if (params.particleType == 1) {
+				pd.groupFlags = b2_rigidParticleGroup;
+			} else if (params.particleType == 2) {
+				pd.flags = b2_elasticParticle;
+			}
+			if (g.hasColor) {
+				pd.color.Set(g.color[0], g.color[1], g.color[2], g.color[3]);
+			}
+			pd.linearVelocity.Set(g.velocityX, g.velocityY);
+			pd.strength = g.strength;
+			pd.lifetime = g.lifetime;
+			particleSystem->CreateParticleGroup(pd);
+		}
+
+		_time = 0;
+	}
+
+	virtual void update(float dt) override {
+		_time += dt;
+		updateMotors();
+	}
+
+	virtual void saveState(std::vector<char>& state) const override {
+		state.resize(sizeof(_time));
+		memcpy(state.data(), &_time, sizeof(_time));
+	}
+
+	virtual void restoreState(const std::vector<char>& state) override {
+		if (state.size() == sizeof(_time)) {
+			memcpy(&_time, state.data(), sizeof(_time));
+			updateMotors();
+		}
+	}
+
+private:
+	std::shared_ptr<const SceneImage> _image;
+	std::vector<b2Joint*> _joints;
+	float32 _time = 0;
+
+	// Storage for the shape makeShape() returns
+	struct Shapes {
+		b2CircleShape circle;
+		b2PolygonShape polygon;
+		b2ChainShape chain;
+	};
+
+	const b2Shape* makeShape(const SceneShape& shape, Shapes& shapes) const {
+		const b2Vec2* vertices = _image->vertices.data() + shape.firstVertex;
+		switch (shape.type) {
+		case SceneShapeType::Circle:
+			shapes.circle.m_radius = shape.radius;
+			shapes.circle.m_p.Set(shape.centerX, shape.centerY);
+			return &shapes.circle;
+		case SceneShapeType::Polygon:
+			shapes.polygon.Set(vertices, shape.vertexCount);
+			return &shapes.polygon;
+		case SceneShapeType::Chain:
+		default:
+			if (shape.loop) {
+				shapes.chain.CreateLoop(vertices, shape.vertexCount);
+			} else {
+				shapes.chain.CreateChain(vertices, shape.vertexCount);
+			}
+			return &shapes.chain;
+		}
+	}
+
+	template <typename Def>
+	void setJointDef(Def& jd, const SceneJoint& j, const std::vector<b2Body*>& bodies) const {
+		jd.bodyA = bodies[j.bodyA];
+		jd.bodyB = bodies[j.bodyB];
+		jd.collideConnected = j.collideConnected != 0;
+		jd.localAnchorA.Set(j.anchorAX, j.anchorAY);
+		jd.localAnchorB.Set(j.anchorBX, j.anchorBY);
+	}
+
+	void updateMotors() {
+		for (size_t i = 0; i < _joints.size(); i++) {
+			const SceneJoint& j = _image->joints[i];
+			if (!j.enableMotor || j.motorAmplitude == 0) {
+				continue;
+			}
+			float32 speed = j.motorSpeed + j.motorAmplitude * cosf(j.motorFrequency * _time);
+			if (j.type == SceneJointType::Revolute) {
+				((b2RevoluteJoint*)_joints[i])->SetMotorSpeed(speed);
+			} else if (j.type == SceneJointType::Prismatic) {
+				((b2PrismaticJoint*)_joints[i])->SetMotorSpeed(speed);
+			}
+		}
+	}
+};
@@ -0,0 +1,83 @@
+#include "EmitterLoader.h"
+
+#include <string.h>
+
+#include "LoaderUtils.h"
+
+static uint8 toByte(double value) {
+	return (uint8)(value <= 0 ? 0 : (value >= 1 ? 255 : value * 255 + 0.5));
+}
+
+void EmitterLoader::update(const OP_Inputs* inputs, SimulationParameters& params) {
+	Emitter defaults = {};
+	double x, y;
+	inputs->getParDouble2("Emitterposition", x, y);
+	defaults.x = (float)x;
+	defaults.y = (float)y;
+	defaults.angle = (float)inputs->getParDouble("Emitterangle") * DegreesToRadians;
+	defaults.speed = (float)inputs->getParDouble("Emitterspeed");
+	defaults.rate = (float)inputs->getParDouble("Emitterrate");
+	defaults.spread = (float)inputs->getParDouble("Emitterspread") * DegreesToRadians;
+	defaults.lifetime = (float)inputs->getParDouble("Emitterlifetime");
+	double r, g, b, a;
+	inputs->getParDouble4("Emittercolor", r, g, b, a);
+	defaults.color.Set(toByte(r), toByte(g), toByte(b), toByte(a));
+	defaults.system = inputs->getParInt("Emittersystem");
+
+	const OP_CHOPInput* chop = inputs->getParCHOP("Emitterchop");
+	bool changed = memcmp(&defaults, &_defaults, sizeof(Emitter)) != 0;
+	if (chop) {
+		changed = changed || chop->opId != _chopId || chop->totalCooks != _chopCooks;
+		_chopId = chop->opId;
+		_chopCooks = chop->totalCooks;
+	} else {
+		changed = changed || _chopId != 0 || !_emitters;
+		_chopId = 0;
+		_chopCooks = -1;
+	}
+	_defaults = defaults;
+
+	if (changed) {
+		shared_ptr<vector<Emitter>> emitters = getFreeObject(_pool);
+		emitters->clear();
+		if (!chop) {
+			if (0 < defaults.rate) {
+				emitters->push_back(defaults);
+			}
+		} else {
+			const float* tx = findChannel(chop, "tx");
+			const float* ty = findChannel(chop, "ty");
+			const float* angle = findChannel(chop, "angle");
+			const float* speed = findChannel(chop, "speed");
+			const float* rate = findChannel(chop, "rate");
+			const float* spread = findChannel(chop, "spread");
+			const float* lifetime = findChannel(chop, "lifetime");
+			const float* system = findChannel(chop, "system");
+			const float* color[4] = {
+				findChannel(chop, "r"), findChannel(chop, "g"), findChannel(chop, "b"), findChannel(chop, "a") };
+			emitters->resize(chop->numSamples);
+			for (int i = 0; i < chop->numSamples; i++) {
+				Emitter& emitter = (*emitters)[i];
+				emitter.x = tx ? tx[i] : defaults.x;
+				emitter.y = ty ? ty[i] : defaults.y;
+				emitter.angle = angle ? angle[i] * DegreesToRadians : defaults.angle;
+				emitter.speed = speed ? speed[i] : defaults.speed;
+				emitter.rate = rate ? rate[i] : defaults.rate;
+				emitter.spread = spread ? spread[i] * DegreesToRadians : defaults.spread;
+				emitter.lifetime = lifetime ? lifetime[i] : defaults.lifetime;
+				emitter.color.Set(
+					color[0] ? toByte(color[0][i]) : defaults.color.r,
+					color[1] ? toByte(color[1][i]) : defaults.color.g,
+					color[2] ? toByte(color[2][i]) : defaults.color.b,
+					color[3] ? toByte(color[3][i]) : defaults.color.a);
+				emitter.system = system ? (int)system[i] : defaults.system;
+			}
+		}
+		// A CHOP that cooks without moving anything changes nothing
+		if (!sameItems(_emitters.get(), *emitters)) {
+			_emitters = emitters;
+		}
+	}
+
+	params.emitters = _emitters;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+#include "EmitterPool.h"
+#include "SimulationParameters.h"
+
+using namespace std;
+
+// Follows the Emitter parameters of one CHOP. Without an Emitter CHOP the
+// parameters describe one emitter. With one, every sample is an emitter and
+// its tx, ty, angle, speed, rate, spread, lifetime, r, g, b, a and system
+// channels override the parameters; angles are in degrees. Lists the
+// simulation has let go of are reused, so a CHOP that cooks every frame
+// doesn't allocate.
+class EmitterLoader {
+public:
+	// Sets the emitters in params
+	void update(const OP_Inputs* inputs, SimulationParameters& params);
+
+private:
+	uint32_t _chopId = 0;
+	int64_t _chopCooks = -1;
+	Emitter _defaults = {};
+	vector<shared_ptr<vector<Emitter>>> _pool;
+	shared_ptr<const vector<Emitter>> _emitters;
+};
@@ -0,0 +1,223 @@
+#include "EmitterPool.h"
+
+#include <cmath>
+#include <string.h>
+
+// Parking grid, in particle diameters. LiquidFun's contact tags cover about
+// 2048 diameters either way from the origin, so the grid stays inside that.
+static const int ParkingColumns = 1024;
+static const float ParkingSpacing = 2.5f;
+static const float ParkingTop = -1200.0f;
+
+void EmitterPool::setup(b2ParticleSystem* particleSystem, int size) {
+	reset();
+	_particleSystem = particleSystem;
+	if (size <= 0) {
+		return;
+	}
+
+	_expiration.assign(size, -1);
+	_alive.assign(size, 0);
+	vector<b2Vec2> positions(size);
+	for (int slot = 0; slot < size; slot++) {
+		positions[slot] = getParkingPosition(slot);
+	}
+
+	b2ParticleGroupDef def;
+	def.flags = b2_wallParticle;
+	def.groupFlags = b2_particleGroupCanBeEmpty;
+	def.particleCount = size;
+	def.positionData = positions.data();
+	_group = particleSystem->CreateParticleGroup(def);
+
+	// Slot 0 is handed out first
+	for (int slot = size - 1; 0 <= slot; slot--) {
+		_free.push_back(slot);
+	}
+}
+
+void EmitterPool::reset() {
+	_particleSystem = NULL;
+	_group = NULL;
+	_expiration.clear();
+	_alive.clear();
+	_free.clear();
+	_owed.clear();
+	_seed = 1;
+	_dropped = 0;
+}
+
+void EmitterPool::update(const vector<Emitter>& emitters, int system, double time, float32 dt) {
+	if (!_group) {
+		return;
+	}
+
+	int size = getSize();
+	for (int slot = 0; slot < size; slot++) {
+		if (0 <= _expiration[slot] && _expiration[slot] <= time) {
+			retire(getBegin() + slot);
+		}
+	}
+
+	_owed.resize(emitters.size(), 0);
+	int begin = getBegin();
+	b2Vec2* positions = _particleSystem->GetPositionBuffer();
+	b2Vec2* velocities = _particleSystem->GetVelocityBuffer();
+	b2ParticleColor* colors = NULL;
+	float32 radius = _particleSystem->GetRadius();
+	for (size_t e = 0; e < emitters.size(); e++) {
+		const Emitter& emitter = emitters[e];
+		if (emitter.rate <= 0 || emitter.system != system) {
+			_owed[e] = 0;
+			continue;
+		}
+		_owed[e] += emitter.rate * dt;
+		int count = (int)_owed[e];
+		_owed[e] -= count;
+
+		for (int i = 0; i < count; i++) {
+			if (_free.empty()) {
+				_dropped += count - i;
+				break;
+			}
+			if (!colors) {
+				colors = _particleSystem->GetColorBuffer();
+			}
+			int slot = _free.back();
+			_free.pop_back();
+			int index = begin + slot;
+
+			float angle = emitter.angle + emitter.spread * (nextRandom() - 0.5f);
+			b2Vec2 direction(cosf(angle), sinf(angle));
+			// Spread over the step as if they came out one after another,
+			// and a little sideways, so they don't start on top of each other
+			float along = emitter.speed * dt * (i + nextRandom()) / count;
+			float across = radius * (nextRandom() - 0.5f);
+			positions[index].Set(
+				emitter.x + direction.x * along - direction.y * across,
+				emitter.y + direction.y * along + direction.x * across);
+			velocities[index].Set(direction.x * emitter.speed, direction.y * emitter.speed);
+			colors[index] = emitter.color;
+			_particleSystem->SetParticleFlags(index, b2_waterParticle);
+
+			_alive[slot] = 1;
+			_expiration[slot] = 0 < emitter.lifetime ? time + emitter.lifetime : -1;
+		}
+	}
+}
+
+bool EmitterPool::isAlive(int index) const {
+	int slot = index - getBegin();
+	return _group && 0 <= slot && slot < getSize() && _alive[slot];
+}
+
+void EmitterPool::retire(int index) {
+	int slot = index - getBegin();
+	if (!isAlive(index)) {
+		return;
+	}
+	parkSlot(slot);
+	_free.push_back(slot);
+}
+
+void EmitterPool::park() {
+	if (!_group) {
+		return;
+	}
+	b2Vec2* positions = _particleSystem->GetPositionBuffer();
+	for (int slot : _free) {
+		positions[getBegin() + slot] = getParkingPosition(slot);
+	}
+}
+
+void EmitterPool::parkSlot(int slot) {
+	int index = getBegin() + slot;
+	_particleSystem->SetParticleFlags(index, b2_wallParticle);
+	_particleSystem->GetPositionBuffer()[index] = getParkingPosition(slot);
+	_particleSystem->GetVelocityBuffer()[index].SetZero();
+	_expiration[slot] = -1;
+	_alive[slot] = 0;
+}
+
+b2Vec2 EmitterPool::getParkingPosition(int slot) const {
+	float32 diameter = 2 * _particleSystem->GetRadius();
+	int column = slot % ParkingColumns;
+	int row = slot / ParkingColumns;
+	return b2Vec2(
+		(column - ParkingColumns / 2) * ParkingSpacing * diameter,
+		(ParkingTop - row * ParkingSpacing) * diameter);
+}
+
+float EmitterPool::nextRandom() {
+	// xorshift32, part of the state so rewinds emit the same particles
+	_seed ^= _seed << 13;
+	_seed ^= _seed >> 17;
+	_seed ^= _seed << 5;
+	return (_seed >> 8) * (1.0f / 16777216.0f);
+}
+
+void EmitterPool::saveState(vector<char>& state) const {
+	int size = getSize();
+	int numFree = (int)_free.size();
+	int numOwed = (int)_owed.size();
+	state.resize(sizeof(int) * 4 + sizeof(_seed) +
+		size * (sizeof(double) + sizeof(uint8)) + numFree * sizeof(int) + numOwed * sizeof(double));
+	char* p = state.data();
+	auto write = [&p](const void* data, size_t bytes) {
+		memcpy(p, data, bytes);
+		p += bytes;
+	};
+	write(&size, sizeof(size));
+	write(&numFree, sizeof(numFree));
+	write(&numOwed, sizeof(numOwed));
+	write(&_dropped, sizeof(_dropped));
+	write(&_seed, sizeof(_seed));
+	write(_expiration.data(), size * sizeof(double));
+	write(_alive.data(), size * sizeof(uint8));
+	write(_free.data(), numFree * sizeof(int));
+	write(_owed.data(), numOwed * sizeof(double));
+}
+
+void EmitterPool::restoreState(const vector<char>& state) {
+	if (!_group) {
+		return;
+	}
+
+	int size = getSize();
+	const char* p = state.data();
+	const char* end = p + state.size();
+	auto read = [&p, end](void* data, size_t bytes) {
+		if ((size_t)(end - p) < bytes) {
+			return false;
+		}
+		memcpy(data, p, bytes);
+		p += bytes;
+		return true;
+	};
+	int savedSize = 0, numFree = 0, numOwed = 0;
+	if (read(&savedSize, sizeof(savedSize)) && savedSize == size &&
+		read(&numFree, sizeof(numFree)) && 0 <= numFree && numFree <= size &&
+		read(&numOwed, sizeof(numOwed)) && 0 <= numOwed &&
+		read(&_dropped, sizeof(_dropped)) &&
+		read(&_seed, sizeof(_seed))) {
+		_free.resize(numFree);
+		_owed.resize(numOwed);
+		if (read(_expiration.data(), size * sizeof(double)) &&
+			read(_alive.data(), size * sizeof(uint8)) &&
+			read(_free.data(), numFree * sizeof(int)) &&
+			read(_owed.data(), numOwed * sizeof(double))) {
+			park();
+			return;
+		}
+	}
+
+	// Nothing to go by, e.g. a warm start: park everything
+	_free.clear();
+	_owed.clear();
+	for (int slot = size - 1; 0 <= slot; slot--) {
+		parkSlot(slot);
+		_free.push_back(slot);
+	}
+	_seed = 1;
+	_dropped = 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+#include "Box2D/Box2D.h"
+
+using namespace std;
+
+// One particle source, see EmitterLoader
+struct Emitter {
+	float x;
+	float y;
+	// Radians
+	float angle;
+	float speed;
+	// Particles per second
+	float rate;
+	// Full width of the cone, radians
+	float spread;
+	// Seconds, 0 to live until retired otherwise
+	float lifetime;
+	b2ParticleColor color;
+	// Particle system it spawns into: 0 for the main one, 1 and up for the
+	// ones from the Systems CHOP
+	int system;
+};
+
+// Fixed set of particles the emitters spawn into. They are created with the
+// world as one particle group, and free ones are parked far below the scene
+// as wall particles spaced so they never touch. Spawning turns a parked
+// particle into a water particle in place and retiring parks it again, so
+// emission never creates or destroys particles: the buffers never
+// reallocate and LiquidFun never has to compact them.
+class EmitterPool {
+public:
+	// Creates 'size' parked particles, none if 0
+	void setup(b2ParticleSystem* particleSystem, int size);
+	void reset();
+
+	// Retires the particles that expired by 'time' in one pass, then spawns
+	// the ones the emitters of 'system' owe for the next 'dt' seconds
+	void update(const vector<Emitter>& emitters, int system, double time, float32 dt);
+
+	// True if 'index' is a particle from the pool, parked or not
+	bool isPooled(int index) const {
+		return _group && getBegin() <= index && index < getBegin() + getSize();
+	}
+	// True if 'index' is a live particle from the pool
+	bool isAlive(int index) const;
+	// Parks a live particle from the pool before its time is up
+	void retire(int index);
+
+	// Moves the free particles back to their spots, e.g. after the radius
+	// changed
+	void park();
+
+	void saveState(vector<char>& state) const;
+	// An empty state parks every particle
+	void restoreState(const vector<char>& state);
+
+	// Buffer range of the pool; it moves when particles before it die
+	int getBegin() const { return _group ? _group->GetBufferIndex() : 0; }
+	int getSize() const { return (int)_expiration.size(); }
+	int getAliveCount() const { return getSize() - (int)_free.size(); }
+	// Spawns skipped because the pool was empty, since setup
+	int getDroppedCount() const { return _dropped; }
+	// Slots of the parked particles, relative to getBegin()
+	const vector<int>& getFreeSlots() const { return _free; }
+	// Simulation time each slot expires at, -1 while parked or immortal
+	const vector<double>& getExpirations() const { return _expiration; }
+
+private:
+	b2Vec2 getParkingPosition(int slot) const;
+	void parkSlot(int slot);
+	float nextRandom();
+
+	b2ParticleSystem* _particleSystem = NULL;
+	b2ParticleGroup* _group = NULL;
+
+	// Simulation time each slot expires at, -1 while parked or immortal
+	vector<double> _expiration;
+	vector<uint8> _alive;
+	vector<int> _free;
+	// Fractional particles owed by each emitter
+	vector<double> _owed;
+	uint32_t _seed = 1;
+	int _dropped = 0;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <cmath>
+
+// Accumulates the real time that elapsed between cooks and hands it out in
+// fixed size physics steps, so the simulation speed doesn't depend on the
+// cook rate. In adaptive mode the caller picks the size of every step.
+class FixedTimestep {
+public:
+	void reset() {
+		_accumulator = 0;
+		_substeps = 0;
+		_dropped = false;
+	}
+
+	// Adds 'elapsed' seconds and returns the number of 'dt' steps to run now.
+	// At most 'maxSubsteps' steps are returned; if the simulation falls further
+	// behind than that the remaining time is dropped, otherwise a slow frame
+	// would make the next one even slower.
+	int advance(double elapsed, double dt, int maxSubsteps) {
+		_substeps = 0;
+		_dropped = false;
+		if (dt <= 0 || maxSubsteps <= 0) {
+			_accumulator = 0;
+			return 0;
+		}
+
+		if (elapsed > 0) {
+			_accumulator += elapsed;
+		}
+		int steps = (int)(_accumulator / dt);
+		if (steps > maxSubsteps) {
+			steps = maxSubsteps;
+			_accumulator = 0;
+			_dropped = true;
+		} else {
+			_accumulator -= steps * dt;
+		}
+		_substeps = steps;
+		return steps;
+	}
+
+	// Adaptive mode. Adds 'elapsed' seconds, then next() hands them out.
+	void accumulate(double elapsed) {
+		_substeps = 0;
+		_dropped = false;
+		if (elapsed > 0) {
+			_accumulator += elapsed;
+		}
+	}
+
+	// Returns the size of the next step, 0 when there is none. The waiting
+	// time is split into even steps no longer than 'stableDt', but none
+	// shorter than 'minDt'; less than that waits for the next cook. After
+	// 'maxSubsteps' steps the rest is dropped, like in advance().
+	double next(double stableDt, double minDt, int maxSubsteps) {
+		if (stableDt <= 0 || minDt <= 0 || _accumulator < minDt) {
+			return 0;
+		}
+		if (_substeps >= maxSubsteps) {
+			_accumulator = 0;
+			_dropped = true;
+			return 0;
+		}
+
+		double dt = _accumulator / ceil(_accumulator / stableDt);
+		if (dt < minDt) {
+			dt = minDt;
+		}
+		_accumulator -= dt;
+		_substeps++;
+		return dt;
+	}
+
+	// Substeps taken by the last advance(), or by next() since accumulate()
+	int getSubsteps() const { return _substeps; }
+
+	// True if the last advance() had to drop time to stay within maxSubsteps
+	bool droppedTime() const { return _dropped; }
+
+	// Time waiting in the accumulator, in seconds
+	double getAccumulator() const { return _accumulator; }
+
+private:
+	double _accumulator = 0;
+	int _substeps = 0;
+	bool _dropped = false;
+};
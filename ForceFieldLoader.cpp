@@ -0,0 +1,29 @@
+#include "ForceFieldLoader.h"
+
+#include <string.h>
+
+#include "LoaderUtils.h"
+
+void ForceFieldLoader::update(const OP_Inputs* inputs, SimulationParameters& params) {
+	const OP_TOPInput* top = inputs->getParTOP("Forcetop");
+	if (!top) {
+		_field = NULL;
+		params.forceField = NULL;
+		return;
+	}
+
+	OP_TOPInputDownloadOptions options;
+	options.downloadType = OP_TOPInputDownloadType::Delayed;
+	options.cpuMemPixelType = OP_CPUMemPixelType::RG32Float;
+	// NULL on the first download, keep the last field until there's one
+	const float* data = (const float*)inputs->getTOPDataInCPUMemory(top, &options);
+	if (data && 0 < top->width && 0 < top->height) {
+		shared_ptr<ForceField> field = getFreeObject(_pool);
+		field->width = top->width;
+		field->height = top->height;
+		field->texels.resize((size_t)top->width * top->height * 2);
+		memcpy(field->texels.data(), data, field->texels.size() * sizeof(float));
+		_field = field;
+	}
+	params.forceField = _field;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+#include "SimulationParameters.h"
+
+using namespace std;
+
+// Copy of a downloaded force TOP: the red and green channels of each pixel,
+// bottom row first
+struct ForceField {
+	int width = 0;
+	int height = 0;
+	vector<float> texels;
+};
+
+// Follows the Forcetop parameter of one CHOP. The TOP is downloaded with
+// OP_TOPInputDownloadType::Delayed, so the cook never waits for the GPU and
+// the field is always one frame old. Fields the simulation has let go of
+// are reused, so a TOP that cooks every frame doesn't allocate.
+class ForceFieldLoader {
+public:
+	// Sets the force field in params
+	void update(const OP_Inputs* inputs, SimulationParameters& params);
+
+private:
+	vector<shared_ptr<ForceField>> _pool;
+	shared_ptr<const ForceField> _field;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+// Solver settings of one frame
+struct SolverSettings {
+	int velocityIterations;
+	int positionIterations;
+	int particleIterations;
+	int maxSubsteps;
+};
+
+// Trades solver quality for time when frames take longer than the budget.
+// The settings between the full ones and the minimums form a ladder: each
+// level down takes one particle iteration, then one velocity iteration,
+// then one position iteration and last one substep, until all are at their
+// minimum. The frame time is averaged, and a level is only given back once
+// the average is well under the budget and has settled since the last
+// change, so the quality doesn't flip back and forth.
+class FrameGovernor {
+public:
+	// Share of the budget the average has to drop under to raise the quality
+	static constexpr double RestoreFraction = 0.7;
+	// Frames to wait after a change before judging it
+	static const int SettleFrames = 15;
+	// Weight of the newest frame in the average
+	static constexpr double Smoothing = 0.2;
+
+	void reset() {
+		_level = 0;
+		_average = 0;
+		_settle = 0;
+	}
+
+	// Feeds the milliseconds the last frame took and moves at most one level
+	void update(double frameMS, double budgetMS, const SolverSettings& full, const SolverSettings& minimum) {
+		_average = _average <= 0 ? frameMS : _average + (frameMS - _average) * Smoothing;
+		int numLevels = getNumLevels(full, minimum);
+		if (_level > numLevels) {
+			_level = numLevels;
+		}
+		if (0 < _settle) {
+			_settle--;
+			return;
+		}
+		if (budgetMS < _average && _level < numLevels) {
+			_level++;
+			_settle = SettleFrames;
+		} else if (_average < budgetMS * RestoreFraction && 0 < _level) {
+			_level--;
+			_settle = SettleFrames;
+		}
+	}
+
+	// The settings of the current level
+	SolverSettings apply(const SolverSettings& full, const SolverSettings& minimum) const {
+		SolverSettings settings = full;
+		int remaining = _level;
+		lower(settings.particleIterations, minimum.particleIterations, remaining);
+		lower(settings.velocityIterations, minimum.velocityIterations, remaining);
+		lower(settings.positionIterations, minimum.positionIterations, remaining);
+		lower(settings.maxSubsteps, minimum.maxSubsteps, remaining);
+		return settings;
+	}
+
+	// 0 at full quality
+	int getLevel() const { return _level; }
+	// Averaged frame time in milliseconds
+	double getAverage() const { return _average; }
+
+private:
+	static int getNumLevels(const SolverSettings& full, const SolverSettings& minimum) {
+		return range(full.particleIterations, minimum.particleIterations) +
+			range(full.velocityIterations, minimum.velocityIterations) +
+			range(full.positionIterations, minimum.positionIterations) +
+			range(full.maxSubsteps, minimum.maxSubsteps);
+	}
+
+	static int range(int full, int minimum) {
+		return full > minimum ? full - minimum : 0;
+	}
+
+	static void lower(int& value, int minimum, int& levels) {
+		int step = range(value, minimum);
+		if (step > levels) {
+			step = levels;
+		}
+		value -= step;
+		levels -= step;
+	}
+
+	int _level = 0;
+	double _average = 0;
+	int _settle = 0;
+};
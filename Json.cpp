@@ -0,0 +1,246 @@
+#include "Json.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const JsonValue* JsonValue::get(const char* key) const {
+	for (const auto& member : members) {
+		if (member.first == key) {
+			return &member.second;
+		}
+	}
+	return NULL;
+}
+
+double JsonValue::getNumber(const char* key, double defaultValue) const {
+	const JsonValue* value = get(key);
+	return value && value->isNumber() ? value->number : defaultValue;
+}
+
+bool JsonValue::getBool(const char* key, bool defaultValue) const {
+	const JsonValue* value = get(key);
+	return value && value->type == Type::Bool ? value->boolValue : defaultValue;
+}
+
+string JsonValue::getString(const char* key, const char* defaultValue) const {
+	const JsonValue* value = get(key);
+	return value && value->isString() ? value->text : string(defaultValue);
+}
+
+bool JsonValue::getPair(const char* key, float& x, float& y) const {
+	const JsonValue* value = get(key);
+	if (!value || !value->isArray() || value->items.size() != 2 ||
+		!value->items[0].isNumber() || !value->items[1].isNumber()) {
+		return false;
+	}
+	x = (float)value->items[0].number;
+	y = (float)value->items[1].number;
+	return true;
+}
+
+namespace {
+
+class JsonParser {
+public:
+	JsonParser(const string& text) : _p(text.c_str()), _begin(text.c_str()), _end(text.c_str() + text.size()) {}
+
+	bool parse(JsonValue& value, string& error) {
+		if (!parseValue(value, 0)) {
+			error = _error;
+			return false;
+		}
+		skipSpace();
+		if (_p != _end) {
+			fail("unexpected text after the value");
+			error = _error;
+			return false;
+		}
+		return true;
+	}
+
+private:
+	// Deep enough for any scene, shallow enough for the stack
+	static const int MaxDepth = 64;
+
+	const char* _p;
+	const char* _begin;
+	const char* _end;
+	string _error;
+
+	bool fail(const char* message) {
+		int line = 1;
+		for (const char* c = _begin; c < _p; c++) {
+			if (*c == '\n') {
+				line++;
+			}
+		}
+		_error = "line " + to_string(line) + ": " + message;
+		return false;
+	}
+
+	void skipSpace() {
+		while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r')) {
+			_p++;
+		}
+	}
+
+	bool consume(const char* word) {
+		size_t n = strlen(word);
+		if ((size_t)(_end - _p) >= n && !strncmp(_p, word, n)) {
+			_p += n;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseValue(JsonValue& value, int depth) {
+		if (depth > MaxDepth) {
+			return fail("nested too deeply");
+		}
+		skipSpace();
+		if (_p == _end) {
+			return fail("unexpected end");
+		}
+
+		char c = *_p;
+		if (c == '{') {
+			return parseObject(value, depth);
+		} else if (c == '[') {
+			return parseArray(value, depth);
+		} else if (c == '"') {
+			value.type = JsonValue::Type::String;
+			return parseString(value.text);
+		} else if (consume("true")) {
+			value.type = JsonValue::Type::Bool;
+			value.boolValue = true;
+			return true;
+		} else if (consume("false")) {
+			value.type = JsonValue::Type::Bool;
+			value.boolValue = false;
+			return true;
+		} else if (consume("null")) {
+			value.type = JsonValue::Type::Null;
+			return true;
+		} else if (c == '-' || ('0' <= c && c <= '9')) {
+			// strtod stops at the end of the number; the text is null terminated
+			char* end = NULL;
+			value.type = JsonValue::Type::Number;
+			value.number = strtod(_p, &end);
+			if (end == _p) {
+				return fail("bad number");
+			}
+			_p = end;
+			return true;
+		}
+		return fail("unexpected character");
+	}
+
+	bool parseString(string& text) {
+		_p++;
+		text.clear();
+		while (_p < _end && *_p != '"') {
+			char c = *_p++;
+			if (c != '\\') {
+				text += c;
+				continue;
+			}
+			if (_p == _end) {
+				break;
+			}
+			c = *_p++;
+			switch (c) {
+			case 'n': text += '\n'; break;
+			case 't': text += '\t'; break;
+			case 'r': text += '\r'; break;
+			case 'b': text += '\b'; break;
+			case 'f': text += '\f'; break;
+			case 'u': {
+				if (_end - _p < 4) {
+					return fail("bad escape");
+				}
+				string hex(_p, 4);
+				long code = strtol(hex.c_str(), NULL, 16);
+				text += code < 0x80 ? (char)code : '?';
+				_p += 4;
+				break;
+			}
+			default: text += c; break;
+			}
+		}
+		if (_p == _end) {
+			return fail("unterminated string");
+		}
+		_p++;
+		return true;
+	}
+
+	bool parseArray(JsonValue& value, int depth) {
+		_p++;
+		value.type = JsonValue::Type::Array;
+		skipSpace();
+		if (_p < _end && *_p == ']') {
+			_p++;
+			return true;
+		}
+		while (true) {
+			value.items.emplace_back();
+			if (!parseValue(value.items.back(), depth + 1)) {
+				return false;
+			}
+			skipSpace();
+			if (_p < _end && *_p == ',') {
+				_p++;
+			} else if (_p < _end && *_p == ']') {
+				_p++;
+				return true;
+			} else {
+				return fail("expected ',' or ']'");
+			}
+		}
+	}
+
+	bool parseObject(JsonValue& value, int depth) {
+		_p++;
+		value.type = JsonValue::Type::Object;
+		skipSpace();
+		if (_p < _end && *_p == '}') {
+			_p++;
+			return true;
+		}
+		while (true) {
+			skipSpace();
+			if (_p == _end || *_p != '"') {
+				return fail("expected a key");
+			}
+			value.members.emplace_back();
+			if (!parseString(value.members.back().first)) {
+				return false;
+			}
+			skipSpace();
+			if (_p == _end || *_p != ':') {
+				return fail("expected ':'");
+			}
+			_p++;
+			if (!parseValue(value.members.back().second, depth + 1)) {
+				return false;
+			}
+			skipSpace();
+			if (_p < _end && *_p == ',') {
+				_p++;
+			} else if (_p < _end && *_p == '}') {
+				_p++;
+				return true;
+			} else {
+				return fail("expected ',' or '}'");
+			}
+		}
+	}
+};
+
+}
+
+bool parseJson(const string& text, JsonValue& value, string& error) {
+	value = JsonValue();
+	JsonParser parser(text);
+	return parser.parse(value, error);
+}
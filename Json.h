@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Just enough JSON for scene files: no \u escapes outside ASCII, numbers are
+// doubles, objects keep their key order.
+class JsonValue {
+public:
+	enum class Type {
+		Null,
+		Bool,
+		Number,
+		String,
+		Array,
+		Object,
+	};
+
+	Type type = Type::Null;
+	bool boolValue = false;
+	double number = 0;
+	string text;
+	vector<JsonValue> items;
+	vector<pair<string, JsonValue>> members;
+
+	bool isNull() const { return type == Type::Null; }
+	bool isNumber() const { return type == Type::Number; }
+	bool isString() const { return type == Type::String; }
+	bool isArray() const { return type == Type::Array; }
+	bool isObject() const { return type == Type::Object; }
+
+	// Member of an object, NULL if missing
+	const JsonValue* get(const char* key) const;
+
+	double getNumber(const char* key, double defaultValue) const;
+	bool getBool(const char* key, bool defaultValue) const;
+	string getString(const char* key, const char* defaultValue) const;
+	// Reads [x, y] into x and y, leaving them alone if missing
+	bool getPair(const char* key, float& x, float& y) const;
+};
+
+// Returns false and a message with the line number on a syntax error
+bool parseJson(const string& text, JsonValue& value, string& error);
@@ -0,0 +1,34 @@
+#include "KillZoneLoader.h"
+
+#include "LoaderUtils.h"
+
+void KillZoneLoader::update(const OP_Inputs* inputs, SimulationParameters& params) {
+	const OP_CHOPInput* chop = inputs->getParCHOP("Killchop");
+	if (!chop) {
+		_chopId = 0;
+		_chopCooks = -1;
+		_zones = NULL;
+	} else if (chop->opId != _chopId || chop->totalCooks != _chopCooks) {
+		_chopId = chop->opId;
+		_chopCooks = chop->totalCooks;
+
+		const float* tx = findChannel(chop, "tx");
+		const float* ty = findChannel(chop, "ty");
+		const float* w = findChannel(chop, "w");
+		const float* h = findChannel(chop, "h");
+
+		shared_ptr<vector<KillZone>> zones(new vector<KillZone>());
+		for (int i = 0; i < chop->numSamples; i++) {
+			float x = tx ? tx[i] : 0;
+			float y = ty ? ty[i] : 0;
+			float halfWidth = (w ? w[i] : 0) / 2;
+			float halfHeight = (h ? h[i] : 0) / 2;
+			if (0 < halfWidth && 0 < halfHeight) {
+				zones->push_back({ x - halfWidth, y - halfHeight, x + halfWidth, y + halfHeight });
+			}
+		}
+		_zones = zones;
+	}
+
+	params.killZones = _zones;
+}
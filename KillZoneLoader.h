@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+#include "SimulationParameters.h"
+
+using namespace std;
+
+// World rectangle whose particles are culled every step
+struct KillZone {
+	float minX;
+	float minY;
+	float maxX;
+	float maxY;
+};
+
+// Follows the Killchop parameter of one CHOP: one kill zone per sample,
+// centered on tx, ty and w by h in size.
+class KillZoneLoader {
+public:
+	// Sets the kill zones in params
+	void update(const OP_Inputs* inputs, SimulationParameters& params);
+
+private:
+	uint32_t _chopId = 0;
+	int64_t _chopCooks = -1;
+	shared_ptr<const vector<KillZone>> _zones;
+};
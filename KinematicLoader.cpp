@@ -0,0 +1,38 @@
+#include "KinematicLoader.h"
+
+#include "LoaderUtils.h"
+
+void KinematicLoader::update(const OP_Inputs* inputs, SimulationParameters& params) {
+	const OP_CHOPInput* chop = inputs->getParCHOP("Kinematicchop");
+	double radius = inputs->getParDouble("Kinematicradius");
+	if (!chop) {
+		_chopId = 0;
+		_chopCooks = -1;
+		_colliders = NULL;
+	} else if (chop->opId != _chopId || chop->totalCooks != _chopCooks || radius != _radius) {
+		_chopId = chop->opId;
+		_chopCooks = chop->totalCooks;
+		_radius = radius;
+
+		const float* tx = findChannel(chop, "tx");
+		const float* ty = findChannel(chop, "ty");
+		const float* rz = findChannel(chop, "rz");
+		const float* radii = findChannel(chop, "radius");
+
+		shared_ptr<vector<KinematicCollider>> colliders = getFreeObject(_pool);
+		colliders->resize(chop->numSamples);
+		for (int i = 0; i < chop->numSamples; i++) {
+			KinematicCollider& collider = (*colliders)[i];
+			collider.x = tx ? tx[i] : 0;
+			collider.y = ty ? ty[i] : 0;
+			collider.angle = rz ? rz[i] * DegreesToRadians : 0;
+			collider.radius = radii ? radii[i] : (float)radius;
+		}
+		// A CHOP that cooks without moving anything changes nothing
+		if (!sameItems(_colliders.get(), *colliders)) {
+			_colliders = colliders;
+		}
+	}
+
+	params.kinematicColliders = _colliders;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+#include "SimulationParameters.h"
+
+using namespace std;
+
+// Where one kinematic collider should be at the end of the frame
+struct KinematicCollider {
+	float x;
+	float y;
+	// Radians
+	float angle;
+	// Circle fixture, none if 0
+	float radius;
+};
+
+// Follows the Kinematicchop parameter of one CHOP: one collider per sample,
+// placed by the tx, ty and rz (degrees) channels and sized by an optional
+// radius channel or the Kinematicradius parameter. The CHOP arrays are read
+// in one pass whenever it cooks, and handed to the simulation as one batch.
+// Batches the simulation has let go of are reused, so a CHOP that cooks
+// every frame doesn't allocate.
+class KinematicLoader {
+public:
+	// Sets the kinematic colliders in params
+	void update(const OP_Inputs* inputs, SimulationParameters& params);
+
+private:
+	uint32_t _chopId = 0;
+	int64_t _chopCooks = -1;
+	double _radius = 0;
+	vector<shared_ptr<vector<KinematicCollider>>> _pool;
+	shared_ptr<const vector<KinematicCollider>> _colliders;
+};
@@ -7,6 +7,8 @@
 #include <assert.h>
 
 #include "Scenes.h"
+#include "AllocationTracker.h"
+#include "Stopwatch.h"
 
 // These functions are basic C function, which the DLL loader can find
 // much easier than finding a C++ Class.
@@ -53,55 +55,114 @@ extern "C" {
 };
 
 
-LiquidFunCHOP::LiquidFunCHOP(const OP_NodeInfo* info) : myNodeInfo(info) {
+LiquidFunCHOP::LiquidFunCHOP(const OP_NodeInfo* info) : _builder(_scenes), myNodeInfo(info) {
+	// Must happen before the first world exists
+	installAllocationTracker();
+
 	shared_ptr<SceneBase> damBreak(new DamBreak());
 	_scenes.push_back(damBreak);
 	shared_ptr<SceneBase> waveMachine(new WaveMachine());
 	_scenes.push_back(waveMachine);
+
+	_simulation.reset(new Simulation(_scenes));
 }
 
 LiquidFunCHOP::~LiquidFunCHOP() {
-	delete _world;
-	_world = NULL;
+	stopSimulationThread();
+	_simulation.reset();
+}
+
+void LiquidFunCHOP::init() {
+	_buildParams = _params;
+	_builder.start(_params);
+	_restartRequested = false;
 }
 
-void LiquidFunCHOP::init(const OP_Inputs* inputs) {
-	// World
-	double gx = 0;
-	double gy = 0;
-	inputs->getParDouble2("Gravity", gx, gy);
-
-	b2Vec2 gravity;
-	gravity.Set(gx, gy);
-	_world = new b2World(gravity);
-
-	// Particle System
-	double radius = inputs->getParDouble("Particlesize");
-	//double gravityScale = inputs->getParDouble("Particlegravityscale");
-	//double density = inputs->getParDouble("Particledensity");
-	double damping = inputs->getParDouble("Particledamping");
-	const b2ParticleSystemDef particleSystemDef;
-	_particleSystem = _world->CreateParticleSystem(&particleSystemDef);
-	_particleSystem->SetGravityScale(0.4f);
-	_particleSystem->SetDensity(1.2f);
-	_particleSystem->SetRadius(radius);
-	_particleSystem->SetDamping(damping);
-
-	b2BodyDef bodyDef;
-	_groundBody = _world->CreateBody(&bodyDef);
-
-	int sceneIndex = inputs->getParInt("Sceneindex");
-	if (0 <= sceneIndex && sceneIndex < _scenes.size()) {
-		auto scene = _scenes[sceneIndex];
-		scene->setup(_world, _particleSystem, inputs);
-		_initialized = true;
-		_sceneIndex = sceneIndex;
+void LiquidFunCHOP::swapBuiltSimulation() {
+	unique_ptr<Simulation> simulation = _builder.take();
+	if (!simulation) {
+		return;
 	}
+	// The worker is restarted on the new world by the caller
+	stopSimulationThread();
+	_simulation = move(simulation);
 }
 
 void LiquidFunCHOP::restart() {
-	delete _world;
-	_initialized = false;
+	// Handled with the next cook's parameters, by the worker in async mode
+	_restartRequested = true;
+}
+
+void LiquidFunCHOP::rewind() {
+	_rewindRequested = true;
+}
+
+void LiquidFunCHOP::saveState() {
+	_saveStateRequested = true;
+}
+
+void LiquidFunCHOP::startSimulationThread() {
+	if (!_simulationThread) {
+		_simulationThread.reset(new SimulationThread(_simulation.get()));
+		_postedParams = _simulation->getParameters();
+		_pendingElapsed = 0;
+	}
+}
+
+void LiquidFunCHOP::stopSimulationThread() {
+	_snapshot = NULL;
+	_simulationThread.reset();
+}
+
+void LiquidFunCHOP::postCommands(double elapsed) {
+	_pendingElapsed += elapsed;
+	// Even if the queue is full, so a world over its quota runs again
+	_simulationThread->startCook();
+
+	if (_params != _postedParams) {
+		SimulationCommand command;
+		command.type = SimulationCommand::Type::SetParameters;
+		command.params = _params;
+		if (!_simulationThread->post(command)) {
+			return;
+		}
+		_postedParams = _params;
+	}
+	if (_restartRequested) {
+		SimulationCommand command;
+		command.type = SimulationCommand::Type::Restart;
+		if (!_simulationThread->post(command)) {
+			return;
+		}
+		_restartRequested = false;
+	}
+	if (_rewindRequested) {
+		SimulationCommand command;
+		command.type = SimulationCommand::Type::Rewind;
+		command.seconds = _params.rewindSeconds;
+		if (!_simulationThread->post(command)) {
+			return;
+		}
+		_rewindRequested = false;
+	}
+	if (_saveStateRequested) {
+		// Saves the frame after the one being output
+		SimulationCommand command;
+		command.type = SimulationCommand::Type::SaveState;
+		if (!_simulationThread->post(command)) {
+			return;
+		}
+		_saveStateRequested = false;
+	}
+	{
+		// If the worker falls behind the elapsed time is carried over
+		SimulationCommand command;
+		command.type = SimulationCommand::Type::Step;
+		command.elapsed = _pendingElapsed;
+		if (_simulationThread->post(command)) {
+			_pendingElapsed = 0;
+		}
+	}
 }
 
 void LiquidFunCHOP::getGeneralInfo(CHOP_GeneralInfo* ginfo, const OP_Inputs* inputs, void* reserved1) {
@@ -118,60 +179,317 @@ void LiquidFunCHOP::getGeneralInfo(CHOP_GeneralInfo* ginfo, const OP_Inputs* inp
 }
 
 bool LiquidFunCHOP::getOutputInfo(CHOP_OutputInfo* info, const OP_Inputs* inputs, void* reserved1) {
-	info->numChannels = 2;
-	info->sampleRate = inputs->getParInt("Fps");
-	if (!_initialized) {
-		init(inputs);
-	} 
-	info->numSamples = _particleSystem->GetParticleCount();
+	Stopwatch stopwatch;
+	_params.load(inputs);
+	_params.sceneHash = _sceneLoader.update(inputs);
+	_colliderLoader.update(inputs, _params);
+	_kinematicLoader.update(inputs, _params);
+	_forceFieldLoader.update(inputs, _params);
+	_emitterLoader.update(inputs, _params);
+	_killZoneLoader.update(inputs, _params);
+	_particleSystemLoader.update(inputs, _params);
+	_paramsTime = stopwatch.elapsedMS();
+
+	bool async = inputs->getParInt("Async") != 0;
+	if (!async) {
+		stopSimulationThread();
+	}
+	swapBuiltSimulation();
+	if (!_simulation->isInitialized()) {
+		if (!_builder.isBuilding()) {
+			init();
+		}
+	} else if (!_params.sameWorld(_buildParams)) {
+		// Everything else is applied to the live world by setParameters()
+		init();
+	} else if (!async) {
+		if (_restartRequested) {
+			// Restoring the setup checkpoint is quick enough to do here. If the
+			// world doesn't match, a fresh one is being built already.
+			if (_params.sameWorld(_simulation->getSetupParameters())) {
+				_simulation->restart(_params);
+			}
+			_restartRequested = false;
+		}
+		if (_rewindRequested) {
+			_simulation->rewind(_params.rewindSeconds);
+			_rewindRequested = false;
+		}
+		if (_saveStateRequested) {
+			_simulation->saveState(_params.warmStartFile.c_str());
+			_saveStateRequested = false;
+		}
+	}
+	if (async && _simulation->isInitialized()) {
+		startSimulationThread();
+		_simulationThread->setSchedule(inputs->getParInt("Priority"), inputs->getParDouble("Cpuquota"));
+	}
+
+	info->sampleRate = _params.fps;
+	if (_simulationThread) {
+		// The snapshot decides the layout, a new mask shows up once the
+		// worker has published a frame with it
+		_snapshot = &_simulationThread->acquire();
+		_channelMask = _snapshot->channelMask;
+		_numParticleSystems = _snapshot->numParticleSystems;
+		info->numSamples = _snapshot->numSamples;
+	} else {
+		stopwatch.restart();
+		_simulation->setParameters(_params);
+		_paramsTime += stopwatch.elapsedMS();
+		_channelMask = _params.channelMask;
+		_numParticleSystems = _simulation->getNumParticleSystems();
+		info->numSamples = _simulation->getOutputLength();
+	}
+	info->numChannels = getNumChannels(_channelMask) * _numParticleSystems;
 	return true;
 }
 
 void
 LiquidFunCHOP::getChannelName(int32_t index, OP_String* name, const OP_Inputs* inputs, void* reserved1) {
-	if (index == 0) {
-		name->setString("tx");
-	} else if (index == 1) {
-		name->setString("ty");
+	// One block per particle system, the extra ones prefixed s1_, s2_...
+	int perSystem = getNumChannels(_channelMask);
+	int system = 0 < perSystem ? index / perSystem : 0;
+	const char* channel = ::getChannelName(_channelMask, index - system * perSystem);
+	if (system == 0) {
+		name->setString(channel);
+		return;
 	}
+	char prefixed[64];
+	snprintf(prefixed, sizeof(prefixed), "s%d_%s", system, channel);
+	name->setString(prefixed);
 }
 
 void LiquidFunCHOP::execute(CHOP_Output* output, const OP_Inputs* inputs, void* reserved) {
+	double elapsed = inputs->getTimeInfo()->deltaMS / 1000.0;
+	_worldStatsDirty = true;
 
-	int velocityIter = inputs->getParInt("Velocityiterations");
-	int positionIter = inputs->getParInt("Positioniterations");
-	int fps = inputs->getParInt("Fps");
-	float dt = 1.0 / fps;
-	_world->Step(dt, velocityIter, positionIter);
+	if (_simulationThread) {
+		// Output the last finished frame, then let the worker step the next one
+		Stopwatch stopwatch;
+		for (int c = 0; c < output->numChannels && c < (int)_snapshot->channels.size(); c++) {
+			int n = (int)_snapshot->channels[c].size();
+			if (n > output->numSamples) {
+				n = output->numSamples;
+			}
+			memcpy(output->channels[c], _snapshot->channels[c].data(), n * sizeof(float));
+			memset(output->channels[c] + n, 0, (output->numSamples - n) * sizeof(float));
+		}
+		_copyTime = stopwatch.elapsedMS();
 
-	if (0 <= _sceneIndex && _sceneIndex < _scenes.size()) {
-		auto scene = _scenes[_sceneIndex];
-		scene->update(dt);
+		postCommands(elapsed);
+		return;
 	}
 
-	b2Vec2* positions = _particleSystem->GetPositionBuffer();
-	int n = _particleSystem->GetParticleCount();
+	_simulation->step(elapsed);
 
-	for (int i = 0; i < n; i++) {
-		output->channels[0][i] = positions[i].x;
-		output->channels[1][i] = positions[i].y;
-	}
+	Stopwatch stopwatch;
+	_simulation->writeChannels(output->channels, output->numSamples);
+	_copyTime = stopwatch.elapsedMS();
 }
 
 int32_t LiquidFunCHOP::getNumInfoCHOPChans(void* reserved1) {
 	// We return the number of channel we want to output to any Info CHOP
-	// connected to the CHOP. In this example we are just going to send one channel.
-	return 2;
+	// connected to the CHOP.
+	return 26;
+}
+
+void LiquidFunCHOP::getInfoCHOPChan(int32_t index, OP_InfoCHOPChan* chan, void* reserved1) {
+	int substeps = 0;
+	double accumulator = 0;
+	SimdLevel simdLevel = SimdLevel::Scalar;
+	bool sleeping = false;
+	SimulationStats stats;
+	if (_simulationThread && _snapshot) {
+		substeps = _snapshot->substeps;
+		accumulator = _snapshot->accumulator;
+		simdLevel = _snapshot->simdLevel;
+		sleeping = _snapshot->sleeping;
+		stats = _snapshot->stats;
+	} else {
+		substeps = _simulation->getTimestep().getSubsteps();
+		accumulator = _simulation->getTimestep().getAccumulator();
+		simdLevel = _simulation->getKernels().level;
+		sleeping = _simulation->isSleeping();
+		stats = _simulation->getStats();
+	}
+
+	if (index == 0) {
+		chan->name->setString("substeps");
+		chan->value = (float)substeps;
+	} else if (index == 1) {
+		chan->name->setString("accumulator_ms");
+		chan->value = (float)(accumulator * 1000.0);
+	} else if (index == 2) {
+		// Kernel set in use, see SimdLevel
+		chan->name->setString("simd");
+		chan->value = (float)simdLevel;
+	} else if (index == 3) {
+		chan->name->setString("sleeping");
+		chan->value = sleeping ? 1.0f : 0.0f;
+	} else if (index == 4) {
+		chan->name->setString("copy_ms");
+		chan->value = (float)_copyTime;
+	} else if (index == 5) {
+		// In async mode the phase times come from the worker's last frame
+		chan->name->setString("step_ms");
+		chan->value = (float)stats.stepTime;
+	} else if (index == 6) {
+		chan->name->setString("update_ms");
+		chan->value = (float)stats.updateTime;
+	} else if (index == 7) {
+		chan->name->setString("params_ms");
+		chan->value = (float)_paramsTime;
+	} else if (index == 8) {
+		chan->name->setString("init_ms");
+		chan->value = (float)stats.initTime;
+	} else if (index == 9) {
+		chan->name->setString("particles");
+		chan->value = (float)stats.particles;
+	} else if (index == 10) {
+		chan->name->setString("contacts");
+		chan->value = (float)stats.contacts;
+	} else if (index == 11) {
+		chan->name->setString("body_contacts");
+		chan->value = (float)stats.bodyContacts;
+	} else if (index == 12) {
+		// LiquidFun's heap is shared by every CHOP in the process, the
+		// particle buffers are this CHOP's own
+		chan->name->setString("allocated_bytes");
+		chan->value = (float)(getTrackedAllocatedBytes() + stats.bufferBytes);
+	} else if (index == 13) {
+		// 1 while a new world is set up in the background
+		chan->name->setString("building");
+		chan->value = _builder.isBuilding() ? 1.0f : 0.0f;
+	} else if (index == 14) {
+		chan->name->setString("emitter_particles");
+		chan->value = (float)stats.emitterParticles;
+	} else if (index == 15) {
+		// Grows while the Emitter Pool is too small for rate * lifetime
+		chan->name->setString("emitter_dropped");
+		chan->value = (float)stats.emitterDropped;
+	} else if (index == 16) {
+		// Totals since the world was built
+		chan->name->setString("culled_zone");
+		chan->value = (float)stats.culledZone;
+	} else if (index == 17) {
+		chan->name->setString("culled_stuck");
+		chan->value = (float)stats.culledStuck;
+	} else if (index == 18) {
+		// Steps the governor has taken down from full quality
+		chan->name->setString("governor_level");
+		chan->value = (float)stats.governorLevel;
+	} else if (index == 19) {
+		chan->name->setString("governor_ms");
+		chan->value = (float)stats.governorTime;
+	} else if (index == 20) {
+		// Solver settings in use, lowered by the governor
+		chan->name->setString("velocity_iterations");
+		chan->value = (float)stats.velocityIterations;
+	} else if (index == 21) {
+		chan->name->setString("position_iterations");
+		chan->value = (float)stats.positionIterations;
+	} else if (index == 22) {
+		chan->name->setString("particle_iterations");
+		chan->value = (float)stats.particleIterations;
+	} else if (index == 23) {
+		chan->name->setString("max_substeps");
+		chan->value = (float)stats.maxSubsteps;
+	} else if (index == 24) {
+		// Length of the last substep, from the Courant number in adaptive mode
+		chan->name->setString("timestep_ms");
+		chan->value = (float)(stats.timeStep * 1000.0);
+	} else if (index == 25) {
+		// Grows when a substep created more particles than the buffers had
+		// room for; those were dropped and the buffers grown for the next one
+		chan->name->setString("buffers_full");
+		chan->value = (float)stats.buffersFull;
+	}
 }
 
 bool LiquidFunCHOP::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved1) {
-	return false;
+	// Only called while an Info DAT is looking, so the stats are computed here
+	if (_worldStatsDirty) {
+		_worldStatsDirty = false;
+		if (_simulationThread) {
+			// The worker computes them with its next frame, until then keep
+			// showing the last ones
+			_simulationThread->requestWorldStats();
+			if (_snapshot && _snapshot->hasWorldStats) {
+				_worldStats = _snapshot->worldStats;
+			}
+		} else {
+			_simulation->computeWorldStats(_worldStats);
+		}
+	}
+
+	infoSize->rows = (int32_t)_worldStats.size() + 1;
+	infoSize->cols = NumWorldStatsColumns;
+	infoSize->byColumn = false;
+	return true;
 }
 
 void LiquidFunCHOP::getInfoDATEntries(int32_t index,
 	int32_t nEntries,
 	OP_InfoDATEntries* entries,
 	void* reserved1) {
+	if (index == 0) {
+		for (int i = 0; i < nEntries && i < NumWorldStatsColumns; i++) {
+			entries->values[i]->setString(WorldStatsColumns[i]);
+		}
+		return;
+	}
+	if (index - 1 >= (int32_t)_worldStats.size()) {
+		return;
+	}
+
+	const WorldStatsRow& row = _worldStats[index - 1];
+	// Rows of the extra particle systems are prefixed like their channels
+	char name[32];
+	if (row.kind == WorldStatsRow::Kind::Group && row.system) {
+		snprintf(name, sizeof(name), "s%d_group%d", row.system, row.index);
+	} else if (row.kind == WorldStatsRow::Kind::Group) {
+		snprintf(name, sizeof(name), "group%d", row.index);
+	} else if (row.kind == WorldStatsRow::Kind::Ungrouped && row.system) {
+		snprintf(name, sizeof(name), "s%d_ungrouped", row.system);
+	} else if (row.kind == WorldStatsRow::Kind::Ungrouped) {
+		snprintf(name, sizeof(name), "ungrouped");
+	} else {
+		snprintf(name, sizeof(name), "body%d", row.index);
+	}
+	const float values[] = {
+		row.centroidX, row.centroidY,
+		row.minX, row.minY, row.maxX, row.maxY,
+		row.meanSpeed, row.maxSpeed,
+	};
+
+	char text[32];
+	for (int i = 0; i < nEntries && i < NumWorldStatsColumns; i++) {
+		if (i == 0) {
+			entries->values[i]->setString(name);
+			continue;
+		}
+		if (i == 1) {
+			snprintf(text, sizeof(text), "%d", row.particles);
+		} else if (i < 10) {
+			snprintf(text, sizeof(text), "%g", values[i - 2]);
+		} else if (i == 10) {
+			snprintf(text, sizeof(text), "%u", row.flags);
+		} else {
+			snprintf(text, sizeof(text), "%zu", row.bytes);
+		}
+		entries->values[i]->setString(text);
+	}
+}
+
+void LiquidFunCHOP::getWarningString(OP_String* warning, void* reserved1) {
+	if (!_sceneLoader.getError().empty()) {
+		string text = "Scene: " + _sceneLoader.getError();
+		if (_params.sceneHash) {
+			text += " (keeping the last good scene)";
+		}
+		warning->setString(text.c_str());
+	}
 }
 
 void LiquidFunCHOP::setupParameters(OP_ParameterManager* manager, void* reserved1) {
@@ -185,6 +503,73 @@ void LiquidFunCHOP::setupParameters(OP_ParameterManager* manager, void* reserved
 		OP_ParAppendResult res = manager->appendPulse(np);
 		assert(res == OP_ParAppendResult::Success);
 	}
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Rewind";
+		np.label = "Rewind";
+
+		OP_ParAppendResult res = manager->appendPulse(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Rewindseconds";
+		np.label = "Rewind Seconds";
+		np.defaultValues[0] = 2.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Periodic checkpoints to rewind to, 0 seconds turns them off
+	{
+		OP_NumericParameter np;
+		np.name = "Checkpointinterval";
+		np.label = "Checkpoint Interval";
+		np.defaultValues[0] = 1.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Checkpoints";
+		np.label = "Checkpoints";
+		np.defaultValues[0] = 10;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 60;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Start from a saved, already settled state
+	{
+		OP_StringParameter sp;
+		sp.name = "Warmstartfile";
+		sp.label = "Warm Start File";
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Savestate";
+		np.label = "Save State";
+
+		OP_ParAppendResult res = manager->appendPulse(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
 	// Scene
 	{
 		if (0 < _scenes.size()) {
@@ -200,6 +585,295 @@ void LiquidFunCHOP::setupParameters(OP_ParameterManager* manager, void* reserved
 			manager->appendInt(np);
 		}
 	}
+	// Scene described in JSON, see SceneImage.h. A DAT wins over a file.
+	{
+		OP_StringParameter sp;
+		sp.name = "Scenefile";
+		sp.label = "Scene File";
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_StringParameter sp;
+		sp.name = "Scenedat";
+		sp.label = "Scene DAT";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Closed polygons of a SOP (in XY) collide with the particles. Moving
+	// the SOP rigidly moves the collider without rebuilding it.
+	{
+		OP_StringParameter sp;
+		sp.name = "Collidersop";
+		sp.label = "Collider SOP";
+
+		OP_ParAppendResult res = manager->appendSOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_StringParameter sp;
+		sp.name = "Collidermode";
+		sp.label = "Collider Mode";
+		sp.defaultValue = "Outline";
+
+		const char* names[] = { "Outline", "Solid" };
+		const char* labels[] = { "Outline", "Solid" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// One kinematic circle per sample, moved to tx, ty, rz every frame
+	{
+		OP_StringParameter sp;
+		sp.name = "Kinematicchop";
+		sp.label = "Kinematic CHOP";
+
+		OP_ParAppendResult res = manager->appendCHOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Kinematicradius";
+		np.label = "Kinematic Radius";
+		np.defaultValues[0] = 0.1;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Red and green of a TOP accelerate the particles, e.g. optical flow.
+	// The image covers Force Size around Force Center.
+	{
+		OP_StringParameter sp;
+		sp.name = "Forcetop";
+		sp.label = "Force TOP";
+
+		OP_ParAppendResult res = manager->appendTOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Forcecenter";
+		np.label = "Force Center";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 0.0;
+		np.minSliders[0] = -5.0;
+		np.maxSliders[0] = 5.0;
+		np.minSliders[1] = -5.0;
+		np.maxSliders[1] = 5.0;
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Forcesize";
+		np.label = "Force Size";
+		np.defaultValues[0] = 4.0;
+		np.defaultValues[1] = 4.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+		np.minSliders[1] = 0.0;
+		np.maxSliders[1] = 10.0;
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Forcescale";
+		np.label = "Force Scale";
+		np.defaultValues[0] = 1.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 20.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Emitters spawn into a pool of particles set aside when the world is
+	// built, so Emitter Pool has to cover rate * lifetime. 0 turns them off.
+	{
+		OP_NumericParameter np;
+		np.name = "Emitterpool";
+		np.label = "Emitter Pool";
+		np.defaultValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 50000;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// One emitter per sample, its channels override the parameters below
+	{
+		OP_StringParameter sp;
+		sp.name = "Emitterchop";
+		sp.label = "Emitter CHOP";
+
+		OP_ParAppendResult res = manager->appendCHOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Emitterposition";
+		np.label = "Emitter Position";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 1.5;
+		np.minSliders[0] = -5.0;
+		np.maxSliders[0] = 5.0;
+		np.minSliders[1] = -5.0;
+		np.maxSliders[1] = 5.0;
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Emitterangle";
+		np.label = "Emitter Angle";
+		np.defaultValues[0] = -90.0;
+		np.minSliders[0] = -180.0;
+		np.maxSliders[0] = 180.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Emitterspeed";
+		np.label = "Emitter Speed";
+		np.defaultValues[0] = 2.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Emitterrate";
+		np.label = "Emitter Rate";
+		np.defaultValues[0] = 0.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10000.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Emitterspread";
+		np.label = "Emitter Spread";
+		np.defaultValues[0] = 10.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 180.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Emitterlifetime";
+		np.label = "Emitter Lifetime";
+		np.defaultValues[0] = 3.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 20.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Emittercolor";
+		np.label = "Emitter Color";
+		np.defaultValues[0] = 0.3;
+		np.defaultValues[1] = 0.6;
+		np.defaultValues[2] = 1.0;
+		np.defaultValues[3] = 1.0;
+
+		OP_ParAppendResult res = manager->appendRGBA(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// 0 spawns into the main particle system, 1 and up into the ones from
+	// the Systems CHOP
+	{
+		OP_NumericParameter np;
+		np.name = "Emittersystem";
+		np.label = "Emitter System";
+		np.defaultValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 4;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Particles in a kill zone (tx, ty, w, h per sample), outside the
+	// bounds or stuck between bodies are culled; emitted ones go back to
+	// the pool
+	{
+		OP_StringParameter sp;
+		sp.name = "Killchop";
+		sp.label = "Kill CHOP";
+
+		OP_ParAppendResult res = manager->appendCHOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Cullbounds";
+		np.label = "Cull Outside Bounds";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Boundscenter";
+		np.label = "Bounds Center";
+		np.defaultValues[0] = 0.0;
+		np.defaultValues[1] = 0.0;
+		np.minSliders[0] = -5.0;
+		np.maxSliders[0] = 5.0;
+		np.minSliders[1] = -5.0;
+		np.maxSliders[1] = 5.0;
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Boundssize";
+		np.label = "Bounds Size";
+		np.defaultValues[0] = 10.0;
+		np.defaultValues[1] = 10.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 20.0;
+		np.minSliders[1] = 0.0;
+		np.maxSliders[1] = 20.0;
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Stuckthreshold";
+		np.label = "Stuck Threshold";
+		np.defaultValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 100;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
 	// Particle
 	{
 		OP_StringParameter	sp;
@@ -235,6 +909,88 @@ void LiquidFunCHOP::setupParameters(OP_ParameterManager* manager, void* reserved
 
 		OP_ParAppendResult res = manager->appendFloat(np);
 	}
+	// Pause the particles once they have settled
+	{
+		OP_NumericParameter np;
+		np.name = "Particlesleep";
+		np.label = "Particle Sleep";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Sleepskin";
+		np.label = "Sleep Skin";
+		np.defaultValues[0] = 0.01;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 0.1;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+	}
+	// One more particle system per sample (radius, damping, iterations,
+	// pool), filled by the emitters pointing at it. Each outputs its own
+	// block of channels, prefixed s1_, s2_ and so on.
+	{
+		OP_StringParameter sp;
+		sp.name = "Systemschop";
+		sp.label = "Systems CHOP";
+
+		OP_ParAppendResult res = manager->appendCHOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Output attributes
+	for (int i = 0; i < NumParticleAttributes; i++) {
+		const ParticleAttributeInfo& attribute = ParticleAttributes[i];
+		if (!attribute.parameter) {
+			continue;
+		}
+
+		OP_NumericParameter np;
+		np.name = attribute.parameter;
+		np.label = attribute.label;
+		np.page = "Output";
+		np.defaultValues[0] = attribute.attribute == AttributePosition ? 1 : 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Fixed output length
+	{
+		OP_NumericParameter np;
+		np.name = "Fixedcapacity";
+		np.label = "Fixed Capacity";
+		np.page = "Output";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Maxparticles";
+		np.label = "Max Particles";
+		np.page = "Output";
+		np.defaultValues[0] = 10000;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 100000;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Autogrow";
+		np.label = "Auto Grow";
+		np.page = "Output";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
 	// Gravity
 	{
 		OP_NumericParameter	np;
@@ -273,23 +1029,246 @@ void LiquidFunCHOP::setupParameters(OP_ParameterManager* manager, void* reserved
 
 		OP_ParAppendResult res = manager->appendInt(np);
 	}
+	// Particle iterations; LiquidFun solves every particle system of the
+	// world with the same count, the highest one asked for
+	{
+		OP_NumericParameter np;
+		np.name = "Particleiterations";
+		np.label = "Particle Iterations";
+		np.defaultValues[0] = 1;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 8;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
 	// fps
 	{
 		OP_NumericParameter np;
 		np.name = "Fps";
-		np.label = "fps";
+		np.label = "Physics Rate";
 		np.defaultValues[0] = 60;
 		np.minSliders[0] = 0;
 		np.maxSliders[0] = 240;
 
 		OP_ParAppendResult res = manager->appendInt(np);
 	}
+	// Max substeps per cook
+	{
+		OP_NumericParameter np;
+		np.name = "Maxsubsteps";
+		np.label = "Max Substeps";
+		np.defaultValues[0] = 4;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 16;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+	}
+	// Substeps sized so no particle moves more than Courant diameters per
+	// step, instead of 1 / Physics Rate
+	{
+		OP_NumericParameter np;
+		np.name = "Adaptivestep";
+		np.label = "Adaptive Step";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Courant";
+		np.label = "Courant";
+		np.defaultValues[0] = 0.5;
+		np.minSliders[0] = 0.1;
+		np.maxSliders[0] = 2.0;
+		np.minValues[0] = 0.01;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Mintimestep";
+		np.label = "Min Time Step (ms)";
+		np.defaultValues[0] = 1.0;
+		np.minSliders[0] = 0.1;
+		np.maxSliders[0] = 10.0;
+		np.minValues[0] = 0.1;
+		np.clampMins[0] = true;
 
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Maxtimestep";
+		np.label = "Max Time Step (ms)";
+		np.defaultValues[0] = 33.3;
+		np.minSliders[0] = 1.0;
+		np.maxSliders[0] = 50.0;
+		np.minValues[0] = 0.1;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// While frames take longer than the budget, the iterations and substeps
+	// above are lowered step by step down to the minimums below
+	{
+		OP_NumericParameter np;
+		np.name = "Governor";
+		np.label = "Governor";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Framebudget";
+		np.label = "Frame Budget (ms)";
+		np.defaultValues[0] = 8.0;
+		np.minSliders[0] = 1.0;
+		np.maxSliders[0] = 33.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Minvelocityiterations";
+		np.label = "Min Velocity Iterations";
+		np.defaultValues[0] = 2;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 10;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Minpositioniterations";
+		np.label = "Min Position Iterations";
+		np.defaultValues[0] = 1;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 10;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Minparticleiterations";
+		np.label = "Min Particle Iterations";
+		np.defaultValues[0] = 1;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 10;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	{
+		OP_NumericParameter np;
+		np.name = "Minsubsteps";
+		np.label = "Min Substeps";
+		np.defaultValues[0] = 1;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 10;
+		np.minValues[0] = 1;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Threads for the per-particle passes, 0 uses all cores. Async CHOPs
+	// share the pool of the SimulationService instead.
+	{
+		OP_NumericParameter np;
+		np.name = "Threads";
+		np.label = "Threads";
+		np.defaultValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 32;
+		np.minValues[0] = 0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+	}
+	// Instruction set for the per-particle kernels
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Simd";
+		sp.label = "SIMD";
+
+		sp.defaultValue = "Auto";
+
+		const char* names[] = { "Auto", "Scalar", "Sse42", "Avx2" };
+		const char* labels[] = { "Auto", "Scalar", "SSE4.2", "AVX2" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 4, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Step on the worker pool all CHOPs in the process share
+	{
+		OP_NumericParameter np;
+		np.name = "Async";
+		np.label = "Async";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Async CHOPs with a higher priority are stepped first
+	{
+		OP_NumericParameter np;
+		np.name = "Priority";
+		np.label = "Priority";
+		np.defaultValues[0] = 0;
+		np.minSliders[0] = -10;
+		np.maxSliders[0] = 10;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+	// Worker milliseconds an async CHOP may use per cook, 0 for no limit.
+	// Time it's over the quota is made up by skipping cooks.
+	{
+		OP_NumericParameter np;
+		np.name = "Cpuquota";
+		np.label = "CPU Quota (ms)";
+		np.defaultValues[0] = 0.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 33.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
 }
 
 void LiquidFunCHOP::pulsePressed(const char* name, void* reserved1) {
 	if (!strcmp(name, "Restart")) {
 		restart();
+	} else if (!strcmp(name, "Rewind")) {
+		rewind();
+	} else if (!strcmp(name, "Savestate")) {
+		saveState();
 	}
 }
 
@@ -4,7 +4,16 @@
 #include "CHOP_CPlusPlusBase.h"
 #include "Box2D/Box2D.h"
 #include "SceneBase.h"
-#include "Testbed/Framework/ParticleEmitter.h"
+#include "Simulation.h"
+#include "SimulationThread.h"
+#include "SimulationBuilder.h"
+#include "SceneLoader.h"
+#include "ColliderLoader.h"
+#include "KinematicLoader.h"
+#include "ForceFieldLoader.h"
+#include "EmitterLoader.h"
+#include "KillZoneLoader.h"
+#include "ParticleSystemLoader.h"
 
 using namespace std;
 
@@ -37,25 +46,76 @@ public:
 	virtual void execute(CHOP_Output*, const OP_Inputs*, void* reserved) override;
 
 	virtual int32_t getNumInfoCHOPChans(void* reserved1) override;
+	virtual void getInfoCHOPChan(int32_t index, OP_InfoCHOPChan* chan, void* reserved1) override;
 
 	virtual bool getInfoDATSize(OP_InfoDATSize* infoSize, void* resereved1) override;
 	virtual void getInfoDATEntries(int32_t index, int32_t nEntries, OP_InfoDATEntries* entries, void* reserved1) override;
 
+	virtual void getWarningString(OP_String* warning, void* reserved1) override;
+
 	virtual void setupParameters(OP_ParameterManager* manager, void *reserved1) override;
 	virtual void pulsePressed(const char* name, void* reserved1) override;
 
 private:
 	// LiquidFun
-	b2World* _world;
-	b2ParticleSystem* _particleSystem;
-	b2Body* _groundBody;
-	bool _initialized = false;
+	unique_ptr<Simulation> _simulation;
+	SimulationParameters _params;
 
-	void init(const OP_Inputs* inputs);
+	void init();
 	void restart();
+	void rewind();
+	void saveState();
+
+	// Pulses waiting for the next cook, or for the worker in async mode
+	bool _restartRequested = false;
+	bool _rewindRequested = false;
+	bool _saveStateRequested = false;
 
 	vector<shared_ptr<SceneBase>> _scenes;
-	int _sceneIndex = -1;
+	// Scene from the Scenedat or Scenefile parameter, replaces _scenes
+	SceneLoader _sceneLoader;
+	// Collider from the Collidersop parameter
+	ColliderLoader _colliderLoader;
+	// Kinematic colliders from the Kinematicchop parameter
+	KinematicLoader _kinematicLoader;
+	// Force field from the Forcetop parameter
+	ForceFieldLoader _forceFieldLoader;
+	// Emitters from the Emitter parameters and Emitterchop
+	EmitterLoader _emitterLoader;
+	// Kill zones from the Killchop parameter
+	KillZoneLoader _killZoneLoader;
+	// Extra particle systems from the Systemschop parameter
+	ParticleSystemLoader _particleSystemLoader;
+
+	// Builds new worlds in the background. Until one is ready the CHOP keeps
+	// outputting the old world, or nothing on the first build.
+	SimulationBuilder _builder;
+	// Parameters of the newest world, built or still building
+	SimulationParameters _buildParams;
+	void swapBuiltSimulation();
+
+	// Milliseconds spent writing the output channels in the last execute(),
+	// and reading and applying the parameters in the last getOutputInfo()
+	double _copyTime = 0;
+	double _paramsTime = 0;
+	// Attributes in the channels handed out by getOutputInfo()
+	uint32_t _channelMask = 0;
+	// Blocks of them, one per particle system
+	int _numParticleSystems = 1;
+
+	// Rows of the Info DAT, recomputed at most once per cook
+	vector<WorldStatsRow> _worldStats;
+	bool _worldStatsDirty = true;
+
+	// Async mode. While this exists it owns _simulation.
+	unique_ptr<SimulationThread> _simulationThread;
+	const ParticleSnapshot* _snapshot = NULL;
+	SimulationParameters _postedParams;
+	double _pendingElapsed = 0;
+
+	void startSimulationThread();
+	void stopSimulationThread();
+	void postCommands(double elapsed);
 
 	// We don't need to store this pointer, but we do for the example.
 	// The OP_NodeInfo class store information about the node that's using
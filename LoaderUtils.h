@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+
+using namespace std;
+
+// Helpers shared by the loaders that read CHOP inputs
+
+static const float DegreesToRadians = 3.14159265358979f / 180.0f;
+
+// Samples of the channel called 'name', NULL if the CHOP has none
+inline const float* findChannel(const OP_CHOPInput* chop, const char* name) {
+	for (int i = 0; i < chop->numChannels; i++) {
+		if (strcmp(chop->getChannelName(i), name) == 0) {
+			return chop->getChannelData(i);
+		}
+	}
+	return NULL;
+}
+
+// An object from 'pool' the simulation has let go of, or a new one added to
+// it, so inputs that cook every frame don't allocate. Only copies of params
+// hold on to them, and those are all made on the cook thread, so one that is
+// only in the pool stays free.
+template <typename T>
+shared_ptr<T> getFreeObject(vector<shared_ptr<T>>& pool) {
+	for (const shared_ptr<T>& object : pool) {
+		if (object.use_count() == 1) {
+			atomic_thread_fence(memory_order_acquire);
+			return object;
+		}
+	}
+	pool.push_back(make_shared<T>());
+	return pool.back();
+}
+
+// True if 'a' holds the same plain structs as 'b'
+template <typename T>
+bool sameItems(const vector<T>* a, const vector<T>& b) {
+	return a && a->size() == b.size() && (b.empty() || memcmp(a->data(), b.data(), b.size() * sizeof(T)) == 0);
+}
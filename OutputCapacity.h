@@ -0,0 +1,62 @@
+#pragma once
+
+// Number of samples the CHOP outputs in fixed capacity mode. The length only
+// changes when Maxparticles is changed, or when auto grow is on and the
+// particle count has stayed close to the capacity for a while.
+class OutputCapacity {
+public:
+	// Fraction of the capacity that counts as nearly full
+	static constexpr float HighWater = 0.9f;
+	// Updates in a row above the high water mark before growing
+	static const int GrowUpdates = 30;
+	// Capacities are multiples of this
+	static const int Granularity = 1024;
+
+	void reset() {
+		_capacity = 0;
+		_requested = -1;
+		_fullUpdates = 0;
+	}
+
+	// Returns the capacity to use for 'count' particles
+	int update(int count, int requested, bool autoGrow) {
+		if (requested < 1) {
+			requested = 1;
+		}
+		if (requested != _requested) {
+			// Explicit changes always win
+			_requested = requested;
+			_capacity = requested;
+			_fullUpdates = 0;
+		}
+		if (!autoGrow) {
+			_capacity = requested;
+			_fullUpdates = 0;
+			return _capacity;
+		}
+
+		if (count > _capacity) {
+			grow(count);
+		} else if (count > _capacity * HighWater) {
+			if (GrowUpdates <= ++_fullUpdates) {
+				grow(count);
+			}
+		} else {
+			_fullUpdates = 0;
+		}
+		return _capacity;
+	}
+
+	int getCapacity() const { return _capacity; }
+
+private:
+	void grow(int count) {
+		int capacity = count + count / 2;
+		_capacity = (capacity + Granularity - 1) / Granularity * Granularity;
+		_fullUpdates = 0;
+	}
+
+	int _capacity = 0;
+	int _requested = -1;
+	int _fullUpdates = 0;
+};
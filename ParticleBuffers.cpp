@@ -0,0 +1,119 @@
+#include "ParticleBuffers.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+	#include <malloc.h>
+#endif
+
+namespace {
+	b2Vec2* allocateAligned(int count) {
+		size_t size = sizeof(b2Vec2) * count;
+#ifdef _WIN32
+		return (b2Vec2*)_aligned_malloc(size, ParticleBuffers::Alignment);
+#else
+		void* p = NULL;
+		if (posix_memalign(&p, ParticleBuffers::Alignment, size) != 0) {
+			return NULL;
+		}
+		return (b2Vec2*)p;
+#endif
+	}
+
+	void freeAligned(b2Vec2* p) {
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+}
+
+ParticleBuffers::~ParticleBuffers() {
+	release();
+}
+
+void ParticleBuffers::attach(b2ParticleSystem* particleSystem) {
+	release();
+	_particleSystem = particleSystem;
+
+	int count = particleSystem->GetParticleCount();
+	int capacity = MinCapacity;
+	while (capacity < count * 2) {
+		capacity *= 2;
+	}
+	grow(capacity);
+}
+
+void ParticleBuffers::release() {
+	freeAligned(_positions);
+	freeAligned(_velocities);
+	_positions = NULL;
+	_velocities = NULL;
+	_capacity = 0;
+	_stepCount = -1;
+	_fullCount = 0;
+	_particleSystem = NULL;
+}
+
+void ParticleBuffers::reserve(int headroom) {
+	if (!_particleSystem) {
+		return;
+	}
+	// Particles added outside of a step, e.g. by a restore, aren't growth
+	// reserveStep() has to plan for
+	_stepCount = -1;
+	int needed = _particleSystem->GetParticleCount() + headroom;
+	if (needed <= _capacity) {
+		return;
+	}
+	int capacity = _capacity ? _capacity : MinCapacity;
+	while (capacity < needed) {
+		capacity *= 2;
+	}
+	grow(capacity);
+}
+
+void ParticleBuffers::reserveStep() {
+	if (!_particleSystem) {
+		return;
+	}
+	int count = _particleSystem->GetParticleCount();
+	int headroom = MinCapacity;
+	if (0 <= _stepCount && headroom < 2 * (count - _stepCount)) {
+		headroom = 2 * (count - _stepCount);
+	}
+	if (count >= _capacity) {
+		_fullCount++;
+		if (headroom < _capacity) {
+			headroom = _capacity;
+		}
+	}
+	reserve(headroom);
+	_stepCount = count;
+}
+
+void ParticleBuffers::grow(int capacity) {
+	b2Vec2* positions = allocateAligned(capacity);
+	b2Vec2* velocities = allocateAligned(capacity);
+	if (!positions || !velocities) {
+		freeAligned(positions);
+		freeAligned(velocities);
+		return;
+	}
+
+	// Set*Buffer() doesn't copy the particles over, so do it first
+	int count = _particleSystem->GetParticleCount();
+	if (0 < count) {
+		memcpy(positions, _particleSystem->GetPositionBuffer(), sizeof(b2Vec2) * count);
+		memcpy(velocities, _particleSystem->GetVelocityBuffer(), sizeof(b2Vec2) * count);
+	}
+	_particleSystem->SetPositionBuffer(positions, capacity);
+	_particleSystem->SetVelocityBuffer(velocities, capacity);
+
+	freeAligned(_positions);
+	freeAligned(_velocities);
+	_positions = positions;
+	_velocities = velocities;
+	_capacity = capacity;
+}
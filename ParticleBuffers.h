@@ -0,0 +1,45 @@
+#pragma once
+#include "Box2D/Box2D.h"
+
+// Position and velocity storage handed to the particle system through
+// SetPositionBuffer/SetVelocityBuffer. Owning them keeps the buffers the
+// output reads cache line aligned, and lets the capacity be reserved ahead
+// of time instead of reallocating inside CreateParticle.
+// LiquidFun stores these as b2Vec2 arrays, so they can't be laid out as
+// separate x and y arrays; the output deinterleaves them instead.
+class ParticleBuffers {
+public:
+	~ParticleBuffers();
+
+	// Moves the particle system onto our buffers, keeping its particles
+	void attach(b2ParticleSystem* particleSystem);
+	// Frees the buffers. Call after the particle system is destroyed.
+	void release();
+
+	// Grows the buffers if fewer than 'headroom' free slots are left
+	void reserve(int headroom);
+	// Call before each substep. Keeps room for twice what the last substep
+	// added, at least MinCapacity, and doubles the buffers if they filled
+	// up, since CreateParticle fails once they are full.
+	void reserveStep();
+
+	int getCapacity() const { return _capacity; }
+	// Substeps that found the buffers full, so new particles may have been
+	// dropped
+	int getFullCount() const { return _fullCount; }
+	size_t getAllocatedBytes() const { return 2 * sizeof(b2Vec2) * _capacity; }
+
+	static const int Alignment = 64;
+	static const int MinCapacity = 1024;
+
+private:
+	void grow(int capacity);
+
+	b2ParticleSystem* _particleSystem = NULL;
+	b2Vec2* _positions = NULL;
+	b2Vec2* _velocities = NULL;
+	int _capacity = 0;
+	// Particle count at the last reserveStep(), -1 before the first
+	int _stepCount = -1;
+	int _fullCount = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-particle attributes the CHOP can output. A channel mask is an OR of
+// these; channels come out in the order of this enum.
+enum ParticleAttribute : uint32_t {
+	AttributePosition = 1 << 0,
+	AttributeVelocity = 1 << 1,
+	AttributeColor = 1 << 2,
+	AttributeWeight = 1 << 3,
+	AttributeGroup = 1 << 4,
+	AttributeFlags = 1 << 5,
+	AttributeLifetime = 1 << 6,
+	// 1 for live particles, 0 for empty slots in fixed capacity mode
+	AttributeActive = 1 << 7,
+};
+
+// Attributes without a toggle parameter are switched on by other settings
+struct ParticleAttributeInfo {
+	ParticleAttribute attribute;
+	const char* parameter;
+	const char* label;
+	int numChannels;
+	const char* channelNames[4];
+};
+
+static const ParticleAttributeInfo ParticleAttributes[] = {
+	{ AttributePosition, "Outposition", "Position", 2, { "tx", "ty" } },
+	{ AttributeVelocity, "Outvelocity", "Velocity", 2, { "vx", "vy" } },
+	{ AttributeColor, "Outcolor", "Color", 4, { "r", "g", "b", "a" } },
+	{ AttributeWeight, "Outweight", "Weight", 1, { "weight" } },
+	{ AttributeGroup, "Outgroup", "Group Index", 1, { "group" } },
+	{ AttributeFlags, "Outflags", "Flags", 1, { "flags" } },
+	{ AttributeLifetime, "Outlifetime", "Lifetime", 1, { "lifetime" } },
+	{ AttributeActive, NULL, NULL, 1, { "active" } },
+};
+
+static const int NumParticleAttributes = sizeof(ParticleAttributes) / sizeof(ParticleAttributes[0]);
+
+// Value empty slots get in the position channels
+static const float DeadSlotPosition = -10000.0f;
+
+inline int getNumChannels(uint32_t mask) {
+	int n = 0;
+	for (int i = 0; i < NumParticleAttributes; i++) {
+		if (mask & ParticleAttributes[i].attribute) {
+			n += ParticleAttributes[i].numChannels;
+		}
+	}
+	return n;
+}
+
+inline const char* getChannelName(uint32_t mask, int index) {
+	for (int i = 0; i < NumParticleAttributes; i++) {
+		const ParticleAttributeInfo& info = ParticleAttributes[i];
+		if (!(mask & info.attribute)) {
+			continue;
+		}
+		if (index < info.numChannels) {
+			return info.channelNames[index];
+		}
+		index -= info.numChannels;
+	}
+	return "";
+}
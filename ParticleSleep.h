@@ -0,0 +1,37 @@
+#pragma once
+
+// Decides when a settled particle system can be paused.
+// Works like a Verlet skin: the max particle speed times dt is summed up each
+// substep, which bounds how far any particle has travelled. If that stays
+// under the skin distance for SleepSteps substeps nothing has really moved,
+// and solving the particles again wouldn't change the picture.
+//
+// This stands in for a radix sorted proxy buffer and a Verlet skin contact
+// cache, which would have to live in b2ParticleSystem::UpdateContacts in
+// the LiquidFun library. Pausing covers the same mostly-at-rest case from
+// outside: a paused system skips contact finding and the whole solve.
+class ParticleSleep {
+public:
+	static const int SleepSteps = 30;
+
+	void reset() {
+		_travel = 0;
+		_quietSteps = 0;
+	}
+
+	// Call once per substep while awake. Returns true when the system can
+	// go to sleep.
+	bool update(float maxSpeed, float dt, float skin) {
+		_travel += maxSpeed * dt;
+		if (_travel > skin) {
+			reset();
+			return false;
+		}
+		_quietSteps++;
+		return SleepSteps <= _quietSteps;
+	}
+
+private:
+	float _travel = 0;
+	int _quietSteps = 0;
+};
@@ -0,0 +1,51 @@
+#include "ParticleSystemLoader.h"
+
+#include <string.h>
+
+#include "LoaderUtils.h"
+
+void ParticleSystemLoader::update(const OP_Inputs* inputs, SimulationParameters& params) {
+	ParticleSystemSettings defaults;
+	defaults.radius = (float)params.particleSize;
+	defaults.damping = (float)params.particleDamping;
+	defaults.iterations = params.particleIterations;
+	defaults.pool = params.emitterPool;
+
+	const OP_CHOPInput* chop = inputs->getParCHOP("Systemschop");
+	if (!chop) {
+		_chopId = 0;
+		_chopCooks = -1;
+		_systems = NULL;
+	} else if (chop->opId != _chopId || chop->totalCooks != _chopCooks ||
+		memcmp(&defaults, &_defaults, sizeof(ParticleSystemSettings)) != 0) {
+		_chopId = chop->opId;
+		_chopCooks = chop->totalCooks;
+
+		const float* radius = findChannel(chop, "radius");
+		const float* damping = findChannel(chop, "damping");
+		const float* iterations = findChannel(chop, "iterations");
+		const float* pool = findChannel(chop, "pool");
+
+		shared_ptr<vector<ParticleSystemSettings>> systems(new vector<ParticleSystemSettings>(chop->numSamples));
+		for (int i = 0; i < chop->numSamples; i++) {
+			ParticleSystemSettings& system = (*systems)[i];
+			system.radius = radius ? radius[i] : defaults.radius;
+			system.damping = damping ? damping[i] : defaults.damping;
+			system.iterations = iterations ? (int)iterations[i] : defaults.iterations;
+			system.pool = pool ? (int)pool[i] : defaults.pool;
+			if (system.radius <= 0) {
+				system.radius = defaults.radius;
+			}
+			if (system.iterations < 1) {
+				system.iterations = 1;
+			}
+			if (system.pool < 0) {
+				system.pool = 0;
+			}
+		}
+		_systems = systems;
+	}
+	_defaults = defaults;
+
+	params.particleSystems = _systems;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+#include "SimulationParameters.h"
+
+using namespace std;
+
+// Follows the Systemschop parameter of one CHOP: one extra particle system
+// per sample, with its radius, damping, iterations and pool channels. Missing
+// channels take the values of the main particle system.
+class ParticleSystemLoader {
+public:
+	// Sets the extra particle systems in params
+	void update(const OP_Inputs* inputs, SimulationParameters& params);
+
+private:
+	uint32_t _chopId = 0;
+	int64_t _chopCooks = -1;
+	ParticleSystemSettings _defaults = {};
+	shared_ptr<const vector<ParticleSystemSettings>> _systems;
+};
@@ -1,10 +1,24 @@
 #pragma once
+#include <memory>
+#include <vector>
+
 #include "Box2D/Box2D.h"
 #include "CHOP_CPlusPlusBase.h"
+#include "SimulationParameters.h"
 
 class SceneBase {
 
 public:
-	virtual void setup(b2World* world, b2ParticleSystem* particleSystem, const OP_Inputs* inputs) {}
+	virtual ~SceneBase() {}
+
+	// New instance for one world. The CHOP's scene list only holds
+	// prototypes, so worlds built on different threads don't share state.
+	virtual std::shared_ptr<SceneBase> create() const = 0;
+
+	virtual void setup(b2World* world, b2ParticleSystem* particleSystem, const SimulationParameters& params) {}
 	virtual void update(float dt) {}
+
+	// State update() keeps outside the world, for checkpoints
+	virtual void saveState(std::vector<char>& state) const { state.clear(); }
+	virtual void restoreState(const std::vector<char>& state) {}
 };
\ No newline at end of file
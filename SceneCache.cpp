@@ -0,0 +1,80 @@
+#include "SceneCache.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+
+// Every DAT edit compiles a new image, so only the latest are kept alive
+static const size_t MaxCachedScenes = 16;
+
+static mutex cacheMutex;
+static map<uint64_t, weak_ptr<const SceneImage>> cache;
+static deque<shared_ptr<const SceneImage>> cacheOrder;
+
+// Call with cacheMutex locked
+static shared_ptr<const SceneImage> findCachedScene(uint64_t hash) {
+	auto it = cache.find(hash);
+	return it != cache.end() ? it->second.lock() : NULL;
+}
+
+// Call with cacheMutex locked
+static void addScene(const shared_ptr<const SceneImage>& image) {
+	if (cacheOrder.size() >= MaxCachedScenes) {
+		cacheOrder.pop_front();
+	}
+	cacheOrder.push_back(image);
+	cache[image->hash] = image;
+	for (auto it = cache.begin(); it != cache.end();) {
+		if (it->second.expired()) {
+			it = cache.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+uint64_t hashSceneSource(const string& json) {
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : json) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash ? hash : 1;
+}
+
+shared_ptr<const SceneImage> loadScene(const string& json, const char* cachePath, string& error) {
+	uint64_t hash = hashSceneSource(json);
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		shared_ptr<const SceneImage> image = findCachedScene(hash);
+		if (image) {
+			return image;
+		}
+	}
+
+	shared_ptr<SceneImage> image(new SceneImage());
+	image->hash = hash;
+	if (!cachePath || !readSceneImage(cachePath, hash, *image)) {
+		if (!compileScene(json, *image, error)) {
+			return NULL;
+		}
+		if (cachePath) {
+			writeSceneImage(cachePath, *image);
+		}
+	}
+
+	lock_guard<mutex> lock(cacheMutex);
+	// Another CHOP may have loaded the same text meanwhile
+	shared_ptr<const SceneImage> cached = findCachedScene(hash);
+	if (cached) {
+		return cached;
+	}
+	addScene(image);
+	return image;
+}
+
+shared_ptr<const SceneImage> findScene(uint64_t hash) {
+	lock_guard<mutex> lock(cacheMutex);
+	return findCachedScene(hash);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include "SceneImage.h"
+
+using namespace std;
+
+// Compiled scenes shared by every CHOP in the process, keyed by a hash of
+// their JSON. A scene is parsed once; later loads and restarts of the same
+// text just look it up. Only the last MaxCachedScenes images are kept by
+// the cache itself, older ones live on while a loader still holds them.
+
+// Never returns 0, which means "no scene"
+uint64_t hashSceneSource(const string& json);
+
+// Returns the compiled scene, or NULL and a message on errors. Keep the
+// image for as long as the scene is in use, so findScene still finds it.
+// With a cache path the image is also kept on disk, so the next session
+// can skip compiling as well.
+shared_ptr<const SceneImage> loadScene(const string& json, const char* cachePath, string& error);
+
+// NULL if no scene with that hash is loaded
+shared_ptr<const SceneImage> findScene(uint64_t hash);
@@ -0,0 +1,467 @@
+#include "SceneImage.h"
+
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+#include "Json.h"
+#include "MappedFile.h"
+
+struct FlagName {
+	const char* name;
+	uint32_t flag;
+};
+
+static const FlagName ParticleFlagNames[] = {
+	{ "water", b2_waterParticle },
+	{ "wall", b2_wallParticle },
+	{ "spring", b2_springParticle },
+	{ "elastic", b2_elasticParticle },
+	{ "viscous", b2_viscousParticle },
+	{ "powder", b2_powderParticle },
+	{ "tensile", b2_tensileParticle },
+	{ "colorMixing", b2_colorMixingParticle },
+	{ "barrier", b2_barrierParticle },
+	{ "staticPressure", b2_staticPressureParticle },
+	{ "reactive", b2_reactiveParticle },
+	{ "repulsive", b2_repulsiveParticle },
+};
+
+static const FlagName GroupFlagNames[] = {
+	{ "solid", b2_solidParticleGroup },
+	{ "rigid", b2_rigidParticleGroup },
+	{ "canBeEmpty", b2_particleGroupCanBeEmpty },
+};
+
+namespace {
+
+class SceneCompiler {
+public:
+	SceneCompiler(SceneImage& image) : _image(image) {}
+
+	bool compile(const JsonValue& root) {
+		if (!root.isObject()) {
+			return fail("the scene must be an object");
+		}
+
+		const JsonValue* bodies = root.get("bodies");
+		if (bodies) {
+			if (!bodies->isArray()) {
+				return fail("'bodies' must be an array");
+			}
+			for (const JsonValue& body : bodies->items) {
+				if (!compileBody(body)) {
+					return false;
+				}
+			}
+		}
+
+		const JsonValue* joints = root.get("joints");
+		if (joints) {
+			if (!joints->isArray()) {
+				return fail("'joints' must be an array");
+			}
+			for (const JsonValue& joint : joints->items) {
+				if (!compileJoint(joint)) {
+					return false;
+				}
+			}
+		}
+
+		const JsonValue* groups = root.get("particleGroups");
+		if (groups) {
+			if (!groups->isArray()) {
+				return fail("'particleGroups' must be an array");
+			}
+			for (const JsonValue& group : groups->items) {
+				if (!compileGroup(group)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	const string& getError() const { return _error; }
+
+private:
+	SceneImage& _image;
+	string _error;
+
+	bool fail(const string& message) {
+		_error = message;
+		return false;
+	}
+
+	bool compileBody(const JsonValue& value) {
+		if (!value.isObject()) {
+			return fail("bodies must be objects");
+		}
+
+		SceneBody body;
+		memset(&body, 0, sizeof(body));
+		string type = value.getString("type", "static");
+		if (type == "static") {
+			body.type = b2_staticBody;
+		} else if (type == "kinematic") {
+			body.type = b2_kinematicBody;
+		} else if (type == "dynamic") {
+			body.type = b2_dynamicBody;
+		} else {
+			return fail("unknown body type '" + type + "'");
+		}
+		value.getPair("position", body.x, body.y);
+		body.angle = (float)value.getNumber("angle", 0);
+		body.allowSleep = value.getBool("allowSleep", true) ? 1 : 0;
+		body.firstFixture = (int32_t)_image.fixtures.size();
+
+		const JsonValue* fixtures = value.get("fixtures");
+		if (fixtures) {
+			if (!fixtures->isArray()) {
+				return fail("'fixtures' must be an array");
+			}
+			for (const JsonValue& f : fixtures->items) {
+				SceneFixture fixture;
+				memset(&fixture, 0, sizeof(fixture));
+				if (!compileShape(f, fixture.shape)) {
+					return false;
+				}
+				fixture.density = (float)f.getNumber("density", 0);
+				fixture.friction = (float)f.getNumber("friction", 0.2);
+				fixture.restitution = (float)f.getNumber("restitution", 0);
+				_image.fixtures.push_back(fixture);
+			}
+		}
+		body.fixtureCount = (int32_t)_image.fixtures.size() - body.firstFixture;
+		_image.bodies.push_back(body);
+		return true;
+	}
+
+	bool compileJoint(const JsonValue& value) {
+		if (!value.isObject()) {
+			return fail("joints must be objects");
+		}
+
+		SceneJoint joint;
+		memset(&joint, 0, sizeof(joint));
+		string type = value.getString("type", "revolute");
+		if (type == "revolute") {
+			joint.type = SceneJointType::Revolute;
+		} else if (type == "prismatic") {
+			joint.type = SceneJointType::Prismatic;
+		} else if (type == "weld") {
+			joint.type = SceneJointType::Weld;
+		} else {
+			return fail("unknown joint type '" + type + "'");
+		}
+
+		joint.bodyA = (int32_t)value.getNumber("bodyA", -1);
+		joint.bodyB = (int32_t)value.getNumber("bodyB", -1);
+		int numBodies = (int)_image.bodies.size();
+		if (joint.bodyA < 0 || joint.bodyA >= numBodies || joint.bodyB < 0 || joint.bodyB >= numBodies) {
+			return fail("joint bodies must be indices into 'bodies'");
+		}
+		if (joint.bodyA == joint.bodyB) {
+			// b2World::CreateJoint asserts on this
+			return fail("a joint can't connect a body to itself");
+		}
+		value.getPair("anchorA", joint.anchorAX, joint.anchorAY);
+		value.getPair("anchorB", joint.anchorBX, joint.anchorBY);
+		joint.axisX = 1;
+		value.getPair("axis", joint.axisX, joint.axisY);
+		joint.referenceAngle = (float)value.getNumber("referenceAngle", 0);
+		joint.collideConnected = value.getBool("collideConnected", false) ? 1 : 0;
+		if (value.get("lower") || value.get("upper")) {
+			joint.enableLimit = 1;
+			joint.lower = (float)value.getNumber("lower", 0);
+			joint.upper = (float)value.getNumber("upper", 0);
+		}
+
+		const JsonValue* motor = value.get("motor");
+		if (motor && motor->isObject()) {
+			joint.enableMotor = 1;
+			joint.motorSpeed = (float)motor->getNumber("speed", 0);
+			joint.motorAmplitude = (float)motor->getNumber("amplitude", 0);
+			joint.motorFrequency = (float)motor->getNumber("frequency", 1);
+			joint.maxMotorForce = (float)motor->getNumber("maxForce", 1e7);
+		}
+		_image.joints.push_back(joint);
+		return true;
+	}
+
+	bool compileGroup(const JsonValue& value) {
+		if (!value.isObject()) {
+			return fail("particle groups must be objects");
+		}
+
+		SceneParticleGroup group;
+		memset(&group, 0, sizeof(group));
+		if (!compileShape(value, group.shape)) {
+			return false;
+		}
+		if (group.shape.type == SceneShapeType::Chain) {
+			return fail("particle groups can't be chains");
+		}
+
+		const JsonValue* flags = value.get("flags");
+		const JsonValue* groupFlags = value.get("groupFlags");
+		if (flags || groupFlags) {
+			group.hasFlags = 1;
+			if ((flags && !compileFlags(*flags, ParticleFlagNames, sizeof(ParticleFlagNames) / sizeof(FlagName), group.flags)) ||
+				(groupFlags && !compileFlags(*groupFlags, GroupFlagNames, sizeof(GroupFlagNames) / sizeof(FlagName), group.groupFlags))) {
+				return false;
+			}
+		}
+
+		const JsonValue* color = value.get("color");
+		if (color) {
+			if (!color->isArray() || color->items.size() != 4) {
+				return fail("'color' must be [r, g, b, a] from 0 to 1");
+			}
+			group.hasColor = 1;
+			for (int i = 0; i < 4; i++) {
+				double c = color->items[i].number;
+				group.color[i] = (uint8_t)(c <= 0 ? 0 : c >= 1 ? 255 : c * 255 + 0.5);
+			}
+		}
+		value.getPair("velocity", group.velocityX, group.velocityY);
+		group.strength = (float)value.getNumber("strength", 1);
+		group.lifetime = (float)value.getNumber("lifetime", 0);
+		_image.groups.push_back(group);
+		return true;
+	}
+
+	bool compileFlags(const JsonValue& value, const FlagName* names, int numNames, uint32_t& flags) {
+		if (!value.isArray()) {
+			return fail("flags must be arrays of names");
+		}
+		for (const JsonValue& item : value.items) {
+			int i = 0;
+			while (i < numNames && item.text != names[i].name) {
+				i++;
+			}
+			if (i == numNames) {
+				return fail("unknown flag '" + item.text + "'");
+			}
+			flags |= names[i].flag;
+		}
+		return true;
+	}
+
+	bool compileShape(const JsonValue& value, SceneShape& shape) {
+		shape.firstVertex = (int32_t)_image.vertices.size();
+		shape.vertexCount = 0;
+		value.getPair("center", shape.centerX, shape.centerY);
+
+		if (value.get("box")) {
+			float hx = 0;
+			float hy = 0;
+			if (!value.getPair("box", hx, hy) || hx <= 0 || hy <= 0) {
+				return fail("'box' must be [halfWidth, halfHeight]");
+			}
+			// Boxes become polygons here, the same way SetAsBox builds them
+			float angle = (float)value.getNumber("angle", 0);
+			float c = cosf(angle);
+			float s = sinf(angle);
+			const float corners[4][2] = { { -hx, -hy }, { hx, -hy }, { hx, hy }, { -hx, hy } };
+			for (int i = 0; i < 4; i++) {
+				float x = corners[i][0];
+				float y = corners[i][1];
+				_image.vertices.push_back(b2Vec2(shape.centerX + c * x - s * y, shape.centerY + s * x + c * y));
+			}
+			shape.type = SceneShapeType::Polygon;
+			shape.vertexCount = 4;
+			return true;
+		}
+		if (const JsonValue* circle = value.get("circle")) {
+			if (!circle->isNumber() || circle->number <= 0) {
+				return fail("'circle' must be a radius");
+			}
+			shape.type = SceneShapeType::Circle;
+			shape.radius = (float)circle->number;
+			return true;
+		}
+		if (const JsonValue* polygon = value.get("polygon")) {
+			shape.type = SceneShapeType::Polygon;
+			if (!compileVertices(*polygon, shape)) {
+				return false;
+			}
+			if (shape.vertexCount < 3 || shape.vertexCount > b2_maxPolygonVertices) {
+				return fail("polygons need 3 to " + to_string(b2_maxPolygonVertices) + " vertices");
+			}
+			return true;
+		}
+		if (const JsonValue* chain = value.get("chain")) {
+			shape.type = SceneShapeType::Chain;
+			shape.loop = value.getBool("loop", false) ? 1 : 0;
+			if (!compileVertices(*chain, shape)) {
+				return false;
+			}
+			if (shape.vertexCount < (shape.loop ? 3 : 2)) {
+				return fail("chains need at least 2 vertices, loops 3");
+			}
+			return true;
+		}
+		return fail("expected a 'box', 'circle', 'polygon' or 'chain'");
+	}
+
+	bool compileVertices(const JsonValue& value, SceneShape& shape) {
+		if (!value.isArray()) {
+			return fail("vertices must be an array of [x, y]");
+		}
+		for (const JsonValue& item : value.items) {
+			if (!item.isArray() || item.items.size() != 2 || !item.items[0].isNumber() || !item.items[1].isNumber()) {
+				return fail("vertices must be an array of [x, y]");
+			}
+			_image.vertices.push_back(b2Vec2(
+				shape.centerX + (float)item.items[0].number,
+				shape.centerY + (float)item.items[1].number));
+		}
+		shape.vertexCount = (int32_t)_image.vertices.size() - shape.firstVertex;
+		return true;
+	}
+};
+
+}
+
+bool compileScene(const string& json, SceneImage& image, string& error) {
+	JsonValue root;
+	if (!parseJson(json, root, error)) {
+		return false;
+	}
+
+	uint64_t hash = image.hash;
+	image = SceneImage();
+	image.hash = hash;
+	SceneCompiler compiler(image);
+	if (!compiler.compile(root)) {
+		error = compiler.getError();
+		return false;
+	}
+	return true;
+}
+
+// Scene image files: header, then the arrays in SceneImage order
+static const char SceneImageMagic[4] = { 'L', 'F', 'S', 'C' };
+static const uint32_t SceneImageVersion = 1;
+
+struct SceneImageHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	uint32_t bodyCount;
+	uint32_t fixtureCount;
+	uint32_t jointCount;
+	uint32_t groupCount;
+	uint32_t vertexCount;
+	uint32_t reserved;
+};
+
+template <typename T>
+static bool writeArray(FILE* file, const vector<T>& items) {
+	return fwrite(items.data(), sizeof(T), items.size(), file) == items.size();
+}
+
+template <typename T>
+static const uint8_t* readArray(const uint8_t* p, uint32_t count, vector<T>& items) {
+	items.resize(count);
+	memcpy(items.data(), p, count * sizeof(T));
+	return p + count * sizeof(T);
+}
+
+bool writeSceneImage(const char* path, const SceneImage& image) {
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+
+	SceneImageHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SceneImageMagic, sizeof(header.magic));
+	header.version = SceneImageVersion;
+	header.hash = image.hash;
+	header.bodyCount = (uint32_t)image.bodies.size();
+	header.fixtureCount = (uint32_t)image.fixtures.size();
+	header.jointCount = (uint32_t)image.joints.size();
+	header.groupCount = (uint32_t)image.groups.size();
+	header.vertexCount = (uint32_t)image.vertices.size();
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		writeArray(file, image.bodies) &&
+		writeArray(file, image.fixtures) &&
+		writeArray(file, image.joints) &&
+		writeArray(file, image.groups) &&
+		writeArray(file, image.vertices);
+	if (fclose(file) != 0) {
+		ok = false;
+	}
+	if (!ok) {
+		remove(path);
+	}
+	return ok;
+}
+
+bool readSceneImage(const char* path, uint64_t hash, SceneImage& image) {
+	MappedFile file;
+	if (!file.open(path) || file.size() < sizeof(SceneImageHeader)) {
+		return false;
+	}
+
+	SceneImageHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, SceneImageMagic, sizeof(header.magic)) != 0 ||
+		header.version != SceneImageVersion ||
+		header.hash != hash) {
+		return false;
+	}
+	size_t size = sizeof(header) +
+		(size_t)header.bodyCount * sizeof(SceneBody) +
+		(size_t)header.fixtureCount * sizeof(SceneFixture) +
+		(size_t)header.jointCount * sizeof(SceneJoint) +
+		(size_t)header.groupCount * sizeof(SceneParticleGroup) +
+		(size_t)header.vertexCount * sizeof(b2Vec2);
+	if (file.size() != size) {
+		return false;
+	}
+
+	const uint8_t* p = file.data() + sizeof(header);
+	image.hash = hash;
+	p = readArray(p, header.bodyCount, image.bodies);
+	p = readArray(p, header.fixtureCount, image.fixtures);
+	p = readArray(p, header.jointCount, image.joints);
+	p = readArray(p, header.groupCount, image.groups);
+	p = readArray(p, header.vertexCount, image.vertices);
+
+	// The indices come from a file, check them before setup() trusts them
+	for (const SceneBody& body : image.bodies) {
+		if (body.firstFixture < 0 || body.fixtureCount < 0 ||
+			(size_t)body.firstFixture + body.fixtureCount > image.fixtures.size()) {
+			return false;
+		}
+	}
+	for (const SceneJoint& joint : image.joints) {
+		if (joint.bodyA < 0 || joint.bodyB < 0 ||
+			(size_t)joint.bodyA >= image.bodies.size() || (size_t)joint.bodyB >= image.bodies.size()) {
+			return false;
+		}
+	}
+	auto validShape = [&](const SceneShape& shape) {
+		if (shape.type == SceneShapeType::Polygon &&
+			(shape.vertexCount < 3 || shape.vertexCount > b2_maxPolygonVertices)) {
+			return false;
+		}
+		return 0 <= shape.firstVertex && 0 <= shape.vertexCount &&
+			(size_t)shape.firstVertex + shape.vertexCount <= image.vertices.size();
+	};
+	for (const SceneFixture& fixture : image.fixtures) {
+		if (!validShape(fixture.shape)) {
+			return false;
+		}
+	}
+	for (const SceneParticleGroup& group : image.groups) {
+		if (!validShape(group.shape)) {
+			return false;
+		}
+	}
+	return true;
+}
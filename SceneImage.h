@@ -0,0 +1,131 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Box2D/Box2D.h"
+
+using namespace std;
+
+// A scene compiled from its JSON description into flat arrays. Shapes are
+// already turned into vertices, so setting up a world from an image is just
+// a walk over the arrays. See SceneCache for how images are shared.
+//
+// Scene JSON:
+// {
+//   "bodies": [{
+//     "type": "static" | "kinematic" | "dynamic",
+//     "position": [x, y], "angle": a, "allowSleep": true,
+//     "fixtures": [{ <shape>, "density": d, "friction": f, "restitution": r }]
+//   }],
+//   "joints": [{
+//     "type": "revolute" | "prismatic" | "weld",
+//     "bodyA": index, "bodyB": index, "anchorA": [x, y], "anchorB": [x, y],
+//     "axis": [x, y], "referenceAngle": a, "collideConnected": false,
+//     "lower": l, "upper": u,
+//     "motor": { "speed": s, "amplitude": a, "frequency": f, "maxForce": m }
+//   }],
+//   "particleGroups": [{
+//     <shape>, "flags": ["elastic", ...], "groupFlags": ["solid", ...],
+//     "color": [r, g, b, a], "velocity": [x, y], "strength": s, "lifetime": t
+//   }]
+// }
+// <shape> is one of
+//   "box": [halfWidth, halfHeight], "center": [x, y], "angle": a
+//   "circle": radius, "center": [x, y]
+//   "polygon": [[x, y], ...]
+//   "chain": [[x, y], ...], "loop": true
+// A motor's speed is speed + amplitude * cos(frequency * time). Particle
+// groups without flags use the Particle Type parameter.
+
+enum class SceneShapeType : int32_t {
+	Circle,
+	Polygon,
+	Chain,
+};
+
+struct SceneShape {
+	SceneShapeType type;
+	float radius;
+	float centerX;
+	float centerY;
+	int32_t firstVertex;
+	int32_t vertexCount;
+	uint32_t loop;
+};
+
+struct SceneFixture {
+	SceneShape shape;
+	float density;
+	float friction;
+	float restitution;
+};
+
+struct SceneBody {
+	int32_t type;
+	float x;
+	float y;
+	float angle;
+	uint32_t allowSleep;
+	int32_t firstFixture;
+	int32_t fixtureCount;
+};
+
+enum class SceneJointType : int32_t {
+	Revolute,
+	Prismatic,
+	Weld,
+};
+
+struct SceneJoint {
+	SceneJointType type;
+	int32_t bodyA;
+	int32_t bodyB;
+	float anchorAX;
+	float anchorAY;
+	float anchorBX;
+	float anchorBY;
+	float axisX;
+	float axisY;
+	float referenceAngle;
+	uint32_t collideConnected;
+	uint32_t enableLimit;
+	float lower;
+	float upper;
+	uint32_t enableMotor;
+	float motorSpeed;
+	float motorAmplitude;
+	float motorFrequency;
+	float maxMotorForce;
+};
+
+struct SceneParticleGroup {
+	SceneShape shape;
+	// Without explicit flags the Particle Type parameter decides
+	uint32_t hasFlags;
+	uint32_t flags;
+	uint32_t groupFlags;
+	uint32_t hasColor;
+	uint8_t color[4];
+	float velocityX;
+	float velocityY;
+	float strength;
+	float lifetime;
+};
+
+struct SceneImage {
+	uint64_t hash = 0;
+	vector<SceneBody> bodies;
+	vector<SceneFixture> fixtures;
+	vector<SceneJoint> joints;
+	vector<SceneParticleGroup> groups;
+	vector<b2Vec2> vertices;
+};
+
+// Parses and compiles scene JSON. Returns false with a message on errors.
+bool compileScene(const string& json, SceneImage& image, string& error);
+
+// Binary copy of an image, so a scene file is only compiled once
+bool writeSceneImage(const char* path, const SceneImage& image);
+// Fails if the file is missing, damaged or not for 'hash'
+bool readSceneImage(const char* path, uint64_t hash, SceneImage& image);
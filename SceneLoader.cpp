@@ -0,0 +1,81 @@
+#include "SceneLoader.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "SceneCache.h"
+
+// Compiled images are kept next to the scene file
+static const char* SceneImageExtension = ".lfscene";
+
+uint64_t SceneLoader::update(const OP_Inputs* inputs) {
+	const OP_DATInput* dat = inputs->getParDAT("Scenedat");
+	if (dat) {
+		if (dat->opId != _datId || dat->totalCooks != _datCooks) {
+			_datId = dat->opId;
+			_datCooks = dat->totalCooks;
+			_path.clear();
+
+			// A text DAT has its text in one cell, a table is read line by line
+			string json;
+			for (int row = 0; row < dat->numRows; row++) {
+				if (0 < dat->numCols) {
+					json += dat->getCell(row, 0);
+					json += '\n';
+				}
+			}
+			load(json, NULL);
+		}
+		return _hash;
+	}
+	_datId = 0;
+	_datCooks = -1;
+
+	const char* path = inputs->getParFilePath("Scenefile");
+	if (!path || !*path) {
+		_path.clear();
+		_hash = 0;
+		_image = NULL;
+		_error.clear();
+		return 0;
+	}
+
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		// Keeps the last good scene running, like a parse error
+		_path.clear();
+		_error = string("can't open ") + path;
+		return _hash;
+	}
+	if (_path == path && _modified == (int64_t)st.st_mtime && _fileSize == (int64_t)st.st_size) {
+		return _hash;
+	}
+	_path = path;
+	_modified = (int64_t)st.st_mtime;
+	_fileSize = (int64_t)st.st_size;
+
+	string json;
+	FILE* file = fopen(path, "rb");
+	if (file) {
+		char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+			json.append(buffer, n);
+		}
+		fclose(file);
+	}
+	load(json, (_path + SceneImageExtension).c_str());
+	return _hash;
+}
+
+void SceneLoader::load(const string& json, const char* cachePath) {
+	// A typo in the scene mustn't wipe the running world, so errors keep
+	// the last good scene
+	_error.clear();
+	shared_ptr<const SceneImage> image = loadScene(json, cachePath, _error);
+	if (image) {
+		_image = image;
+		_hash = image->hash;
+	}
+}
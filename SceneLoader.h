@@ -0,0 +1,38 @@
+#pragma once
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "CPlusPlus_Common.h"
+#include "SceneImage.h"
+
+using namespace std;
+
+// Follows the Scenedat and Scenefile parameters of one CHOP. The DAT or file
+// is only read again when it has changed, and compiled only if its text is
+// new to the SceneCache.
+class SceneLoader {
+public:
+	// Returns the hash of the scene to build, 0 for the built-in scene
+	// selected by Sceneindex. If the scene can't be loaded the last good
+	// one stays.
+	uint64_t update(const OP_Inputs* inputs);
+
+	// Why the last scene couldn't be loaded, empty if it could
+	const string& getError() const { return _error; }
+
+private:
+	void load(const string& json, const char* cachePath);
+
+	string _path;
+	int64_t _modified = -1;
+	int64_t _fileSize = -1;
+	uint32_t _datId = 0;
+	int64_t _datCooks = -1;
+
+	uint64_t _hash = 0;
+	// Keeps the scene in the SceneCache while it's in use
+	shared_ptr<const SceneImage> _image;
+	string _error;
+};
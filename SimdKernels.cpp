@@ -0,0 +1,361 @@
+#include "SimdKernels.h"
+
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SIMD_X86 1
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SIMD_TARGET(x)
+	#else
+		#define SIMD_TARGET(x) __attribute__((target(x)))
+	#endif
+#else
+	#define SIMD_X86 0
+#endif
+
+namespace {
+
+	// Scalar
+
+	void deinterleaveScalar(const b2Vec2* src, float* x, float* y, int n) {
+		for (int i = 0; i < n; i++) {
+			x[i] = src[i].x;
+			y[i] = src[i].y;
+		}
+	}
+
+	float maxLengthSquaredScalar(const b2Vec2* src, int n) {
+		float result = 0;
+		for (int i = 0; i < n; i++) {
+			float l = src[i].x * src[i].x + src[i].y * src[i].y;
+			result = l > result ? l : result;
+		}
+		return result;
+	}
+
+	int clampIndex(int i, int n) {
+		return i < 0 ? 0 : (i < n ? i : n - 1);
+	}
+
+	void addFieldScalar(const b2Vec2* positions, b2Vec2* velocities, int n, const VectorField& field, float scale) {
+		const float* t = field.texels;
+		int w = field.width;
+		int h = field.height;
+		float maxU = w - 0.5f;
+		float maxV = h - 0.5f;
+		for (int i = 0; i < n; i++) {
+			// Texel centers are at whole numbers
+			float u = (positions[i].x - field.originX) * field.scaleX - 0.5f;
+			float v = (positions[i].y - field.originY) * field.scaleY - 0.5f;
+			float fx = 0, fy = 0;
+			if (u >= -0.5f && u <= maxU && v >= -0.5f && v <= maxV) {
+				float fu = floorf(u);
+				float fv = floorf(v);
+				float tx = u - fu;
+				float ty = v - fv;
+				int x0 = clampIndex((int)fu, w), x1 = clampIndex((int)fu + 1, w);
+				int y0 = clampIndex((int)fv, h), y1 = clampIndex((int)fv + 1, h);
+				const float* a = t + (y0 * w + x0) * 2;
+				const float* b = t + (y0 * w + x1) * 2;
+				const float* c = t + (y1 * w + x0) * 2;
+				const float* d = t + (y1 * w + x1) * 2;
+				float topX = a[0] + tx * (b[0] - a[0]);
+				float topY = a[1] + tx * (b[1] - a[1]);
+				float bottomX = c[0] + tx * (d[0] - c[0]);
+				float bottomY = c[1] + tx * (d[1] - c[1]);
+				fx = topX + ty * (bottomX - topX);
+				fy = topY + ty * (bottomY - topY);
+			}
+			velocities[i].x += fx * scale;
+			velocities[i].y += fy * scale;
+		}
+	}
+
+#if SIMD_X86
+
+	// SSE4.2, 4 vectors per iteration
+
+	SIMD_TARGET("sse4.2")
+	void deinterleaveSse42(const b2Vec2* src, float* x, float* y, int n) {
+		const float* s = &src[0].x;
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m128 a = _mm_loadu_ps(s + i * 2);
+			__m128 b = _mm_loadu_ps(s + i * 2 + 4);
+			_mm_storeu_ps(x + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(y + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		deinterleaveScalar(src + i, x + i, y + i, n - i);
+	}
+
+	SIMD_TARGET("sse4.2")
+	float maxLengthSquaredSse42(const b2Vec2* src, int n) {
+		const float* s = &src[0].x;
+		__m128 m = _mm_setzero_ps();
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m128 a = _mm_loadu_ps(s + i * 2);
+			__m128 b = _mm_loadu_ps(s + i * 2 + 4);
+			__m128 vx = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 vy = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			// New value first: _mm_max_ps returns its second operand for NaN,
+			// so NaNs are skipped like in the scalar loop
+			m = _mm_max_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), m);
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, m);
+		float result = maxLengthSquaredScalar(src + i, n - i);
+		for (int j = 0; j < 4; j++) {
+			result = lanes[j] > result ? lanes[j] : result;
+		}
+		return result;
+	}
+
+	SIMD_TARGET("sse4.2")
+	void addFieldSse42(const b2Vec2* positions, b2Vec2* velocities, int n, const VectorField& field, float scale) {
+		const float* s = &positions[0].x;
+		float* vel = &velocities[0].x;
+		const float* t = field.texels;
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 minUV = _mm_set1_ps(-0.5f);
+		const __m128 maxU = _mm_set1_ps(field.width - 0.5f);
+		const __m128 maxV = _mm_set1_ps(field.height - 0.5f);
+		const __m128 originX = _mm_set1_ps(field.originX);
+		const __m128 originY = _mm_set1_ps(field.originY);
+		const __m128 scaleX = _mm_set1_ps(field.scaleX);
+		const __m128 scaleY = _mm_set1_ps(field.scaleY);
+		const __m128 factor = _mm_set1_ps(scale);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi32(1);
+		const __m128i lastX = _mm_set1_epi32(field.width - 1);
+		const __m128i lastY = _mm_set1_epi32(field.height - 1);
+		const __m128i w = _mm_set1_epi32(field.width);
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m128 a = _mm_loadu_ps(s + i * 2);
+			__m128 b = _mm_loadu_ps(s + i * 2 + 4);
+			__m128 px = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 py = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			__m128 u = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(px, originX), scaleX), half);
+			__m128 v = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(py, originY), scaleY), half);
+			__m128 inside = _mm_and_ps(
+				_mm_and_ps(_mm_cmpge_ps(u, minUV), _mm_cmple_ps(u, maxU)),
+				_mm_and_ps(_mm_cmpge_ps(v, minUV), _mm_cmple_ps(v, maxV)));
+
+			__m128 fu = _mm_floor_ps(u);
+			__m128 fv = _mm_floor_ps(v);
+			__m128 tx = _mm_sub_ps(u, fu);
+			__m128 ty = _mm_sub_ps(v, fv);
+			__m128i iu = _mm_cvttps_epi32(fu);
+			__m128i iv = _mm_cvttps_epi32(fv);
+			__m128i x0 = _mm_min_epi32(_mm_max_epi32(iu, zero), lastX);
+			__m128i x1 = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(iu, one), zero), lastX);
+			__m128i y0 = _mm_mullo_epi32(_mm_min_epi32(_mm_max_epi32(iv, zero), lastY), w);
+			__m128i y1 = _mm_mullo_epi32(_mm_min_epi32(_mm_max_epi32(_mm_add_epi32(iv, one), zero), lastY), w);
+
+			// No gather before AVX2
+			int32_t index[4][4];
+			_mm_storeu_si128((__m128i*)index[0], _mm_add_epi32(y0, x0));
+			_mm_storeu_si128((__m128i*)index[1], _mm_add_epi32(y0, x1));
+			_mm_storeu_si128((__m128i*)index[2], _mm_add_epi32(y1, x0));
+			_mm_storeu_si128((__m128i*)index[3], _mm_add_epi32(y1, x1));
+			__m128 cornerX[4], cornerY[4];
+			for (int k = 0; k < 4; k++) {
+				const int32_t* c = index[k];
+				cornerX[k] = _mm_setr_ps(t[c[0] * 2], t[c[1] * 2], t[c[2] * 2], t[c[3] * 2]);
+				cornerY[k] = _mm_setr_ps(t[c[0] * 2 + 1], t[c[1] * 2 + 1], t[c[2] * 2 + 1], t[c[3] * 2 + 1]);
+			}
+			__m128 topX = _mm_add_ps(cornerX[0], _mm_mul_ps(tx, _mm_sub_ps(cornerX[1], cornerX[0])));
+			__m128 topY = _mm_add_ps(cornerY[0], _mm_mul_ps(tx, _mm_sub_ps(cornerY[1], cornerY[0])));
+			__m128 bottomX = _mm_add_ps(cornerX[2], _mm_mul_ps(tx, _mm_sub_ps(cornerX[3], cornerX[2])));
+			__m128 bottomY = _mm_add_ps(cornerY[2], _mm_mul_ps(tx, _mm_sub_ps(cornerY[3], cornerY[2])));
+			__m128 fx = _mm_and_ps(_mm_add_ps(topX, _mm_mul_ps(ty, _mm_sub_ps(bottomX, topX))), inside);
+			__m128 fy = _mm_and_ps(_mm_add_ps(topY, _mm_mul_ps(ty, _mm_sub_ps(bottomY, topY))), inside);
+
+			fx = _mm_mul_ps(fx, factor);
+			fy = _mm_mul_ps(fy, factor);
+			_mm_storeu_ps(vel + i * 2, _mm_add_ps(_mm_loadu_ps(vel + i * 2), _mm_unpacklo_ps(fx, fy)));
+			_mm_storeu_ps(vel + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(vel + i * 2 + 4), _mm_unpackhi_ps(fx, fy)));
+		}
+		addFieldScalar(positions + i, velocities + i, n - i, field, scale);
+	}
+
+	// AVX2, 8 vectors per iteration
+
+	SIMD_TARGET("avx2")
+	void deinterleaveAvx2(const b2Vec2* src, float* x, float* y, int n) {
+		const float* s = &src[0].x;
+		int i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256 a = _mm256_loadu_ps(s + i * 2);
+			__m256 b = _mm256_loadu_ps(s + i * 2 + 8);
+			// The shuffles work per 128 bit lane, the permute puts the halves in order
+			__m256 vx = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 vy = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			vx = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(vx), _MM_SHUFFLE(3, 1, 2, 0)));
+			vy = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(vy), _MM_SHUFFLE(3, 1, 2, 0)));
+			_mm256_storeu_ps(x + i, vx);
+			_mm256_storeu_ps(y + i, vy);
+		}
+		deinterleaveScalar(src + i, x + i, y + i, n - i);
+	}
+
+	SIMD_TARGET("avx2")
+	float maxLengthSquaredAvx2(const b2Vec2* src, int n) {
+		const float* s = &src[0].x;
+		__m256 m = _mm256_setzero_ps();
+		int i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256 a = _mm256_loadu_ps(s + i * 2);
+			__m256 b = _mm256_loadu_ps(s + i * 2 + 8);
+			__m256 vx = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 vy = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			// No FMA, so the result matches the other kernel sets exactly
+			m = _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), m);
+		}
+		float lanes[8];
+		_mm256_storeu_ps(lanes, m);
+		float result = maxLengthSquaredScalar(src + i, n - i);
+		for (int j = 0; j < 8; j++) {
+			result = lanes[j] > result ? lanes[j] : result;
+		}
+		return result;
+	}
+
+	SIMD_TARGET("avx2")
+	void addFieldAvx2(const b2Vec2* positions, b2Vec2* velocities, int n, const VectorField& field, float scale) {
+		const float* s = &positions[0].x;
+		float* vel = &velocities[0].x;
+		const float* t = field.texels;
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 minUV = _mm256_set1_ps(-0.5f);
+		const __m256 maxU = _mm256_set1_ps(field.width - 0.5f);
+		const __m256 maxV = _mm256_set1_ps(field.height - 0.5f);
+		const __m256 originX = _mm256_set1_ps(field.originX);
+		const __m256 originY = _mm256_set1_ps(field.originY);
+		const __m256 scaleX = _mm256_set1_ps(field.scaleX);
+		const __m256 scaleY = _mm256_set1_ps(field.scaleY);
+		const __m256 factor = _mm256_set1_ps(scale);
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i lastX = _mm256_set1_epi32(field.width - 1);
+		const __m256i lastY = _mm256_set1_epi32(field.height - 1);
+		const __m256i w = _mm256_set1_epi32(field.width);
+		int i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256 a = _mm256_loadu_ps(s + i * 2);
+			__m256 b = _mm256_loadu_ps(s + i * 2 + 8);
+			__m256 px = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 py = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			px = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(px), _MM_SHUFFLE(3, 1, 2, 0)));
+			py = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(py), _MM_SHUFFLE(3, 1, 2, 0)));
+			__m256 u = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(px, originX), scaleX), half);
+			__m256 v = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(py, originY), scaleY), half);
+			__m256 inside = _mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(u, minUV, _CMP_GE_OQ), _mm256_cmp_ps(u, maxU, _CMP_LE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(v, minUV, _CMP_GE_OQ), _mm256_cmp_ps(v, maxV, _CMP_LE_OQ)));
+
+			__m256 fu = _mm256_floor_ps(u);
+			__m256 fv = _mm256_floor_ps(v);
+			__m256 tx = _mm256_sub_ps(u, fu);
+			__m256 ty = _mm256_sub_ps(v, fv);
+			__m256i iu = _mm256_cvttps_epi32(fu);
+			__m256i iv = _mm256_cvttps_epi32(fv);
+			__m256i x0 = _mm256_min_epi32(_mm256_max_epi32(iu, zero), lastX);
+			__m256i x1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(iu, one), zero), lastX);
+			__m256i y0 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(iv, zero), lastY), w);
+			__m256i y1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(iv, one), zero), lastY), w);
+
+			// Float offsets of the four corners' x components
+			__m256i index[4] = {
+				_mm256_slli_epi32(_mm256_add_epi32(y0, x0), 1),
+				_mm256_slli_epi32(_mm256_add_epi32(y0, x1), 1),
+				_mm256_slli_epi32(_mm256_add_epi32(y1, x0), 1),
+				_mm256_slli_epi32(_mm256_add_epi32(y1, x1), 1) };
+			__m256 cornerX[4], cornerY[4];
+			for (int k = 0; k < 4; k++) {
+				cornerX[k] = _mm256_i32gather_ps(t, index[k], 4);
+				cornerY[k] = _mm256_i32gather_ps(t + 1, index[k], 4);
+			}
+			__m256 topX = _mm256_add_ps(cornerX[0], _mm256_mul_ps(tx, _mm256_sub_ps(cornerX[1], cornerX[0])));
+			__m256 topY = _mm256_add_ps(cornerY[0], _mm256_mul_ps(tx, _mm256_sub_ps(cornerY[1], cornerY[0])));
+			__m256 bottomX = _mm256_add_ps(cornerX[2], _mm256_mul_ps(tx, _mm256_sub_ps(cornerX[3], cornerX[2])));
+			__m256 bottomY = _mm256_add_ps(cornerY[2], _mm256_mul_ps(tx, _mm256_sub_ps(cornerY[3], cornerY[2])));
+			__m256 fx = _mm256_and_ps(_mm256_add_ps(topX, _mm256_mul_ps(ty, _mm256_sub_ps(bottomX, topX))), inside);
+			__m256 fy = _mm256_and_ps(_mm256_add_ps(topY, _mm256_mul_ps(ty, _mm256_sub_ps(bottomY, topY))), inside);
+
+			// Back to interleaved pairs, the unpacks work per 128 bit lane
+			fx = _mm256_mul_ps(fx, factor);
+			fy = _mm256_mul_ps(fy, factor);
+			__m256 lo = _mm256_unpacklo_ps(fx, fy);
+			__m256 hi = _mm256_unpackhi_ps(fx, fy);
+			_mm256_storeu_ps(vel + i * 2, _mm256_add_ps(_mm256_loadu_ps(vel + i * 2), _mm256_permute2f128_ps(lo, hi, 0x20)));
+			_mm256_storeu_ps(vel + i * 2 + 8, _mm256_add_ps(_mm256_loadu_ps(vel + i * 2 + 8), _mm256_permute2f128_ps(lo, hi, 0x31)));
+		}
+		addFieldScalar(positions + i, velocities + i, n - i, field, scale);
+	}
+
+#endif
+
+	const SimdKernels scalarKernels = { SimdLevel::Scalar, deinterleaveScalar, maxLengthSquaredScalar, addFieldScalar };
+#if SIMD_X86
+	const SimdKernels sse42Kernels = { SimdLevel::Sse42, deinterleaveSse42, maxLengthSquaredSse42, addFieldSse42 };
+	const SimdKernels avx2Kernels = { SimdLevel::Avx2, deinterleaveAvx2, maxLengthSquaredAvx2, addFieldAvx2 };
+#endif
+
+	SimdLevel detectSimdLevel() {
+#if SIMD_X86
+	#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse42 = (info[2] & (1 << 20)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool avx2 = false;
+		if (7 <= maxLeaf && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+	#else
+		__builtin_cpu_init();
+		bool sse42 = __builtin_cpu_supports("sse4.2");
+		bool avx2 = __builtin_cpu_supports("avx2");
+	#endif
+		if (avx2) {
+			return SimdLevel::Avx2;
+		}
+		if (sse42) {
+			return SimdLevel::Sse42;
+		}
+#endif
+		return SimdLevel::Scalar;
+	}
+}
+
+SimdLevel getSupportedSimdLevel() {
+	static const SimdLevel supported = detectSimdLevel();
+	return supported;
+}
+
+const SimdKernels& getSimdKernels(SimdLevel requested) {
+	SimdLevel supported = getSupportedSimdLevel();
+	SimdLevel level = requested;
+	if (level == SimdLevel::Auto || (int)level > (int)supported) {
+		level = supported;
+	}
+
+	switch (level) {
+#if SIMD_X86
+	case SimdLevel::Avx2:
+		return avx2Kernels;
+	case SimdLevel::Sse42:
+		return sse42Kernels;
+#endif
+	default:
+		return scalarKernels;
+	}
+}
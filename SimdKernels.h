@@ -0,0 +1,48 @@
+#pragma once
+#include "Box2D/Box2D.h"
+
+// Instruction sets the per-particle kernels are built for, in the order of
+// the Simd menu parameter
+enum class SimdLevel {
+	Auto = 0,
+	Scalar,
+	Sse42,
+	Avx2,
+};
+
+// Grid of interleaved (x, y) vectors laid over a rectangle of the world,
+// bottom row first like a downloaded TOP
+struct VectorField {
+	const float* texels;
+	int width;
+	int height;
+	// World position of the bottom left corner
+	float originX;
+	float originY;
+	// Texels per world unit
+	float scaleX;
+	float scaleY;
+};
+
+// Kernels over the b2Vec2 buffers of a particle system. Every kernel set
+// returns the same values and skips NaN inputs the same way.
+struct SimdKernels {
+	SimdLevel level;
+
+	// Splits n interleaved vectors into separate x and y arrays
+	void (*deinterleave)(const b2Vec2* src, float* x, float* y, int n);
+
+	// Largest x * x + y * y of n vectors, 0 if n is 0
+	float (*maxLengthSquared)(const b2Vec2* src, int n);
+
+	// Adds the field bilinearly sampled at each of n positions, times scale,
+	// to the matching velocity. Positions outside the field get nothing.
+	void (*addField)(const b2Vec2* positions, b2Vec2* velocities, int n, const VectorField& field, float scale);
+};
+
+// Best level this CPU runs
+SimdLevel getSupportedSimdLevel();
+
+// Kernels for 'requested', falling back to the best supported level if the
+// CPU can't run it
+const SimdKernels& getSimdKernels(SimdLevel requested);
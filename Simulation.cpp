@@ -0,0 +1,1207 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <string.h>
+
+#include "Stopwatch.h"
+#include "StateFile.h"
+#include "SceneCache.h"
+#include "DataScene.h"
+#include "ColliderGeometry.h"
+#include "KinematicLoader.h"
+#include "ForceFieldLoader.h"
+#include "EmitterLoader.h"
+#include "KillZoneLoader.h"
+#include "ParticleSystemLoader.h"
+
+// Particles per chunk for the per-particle passes
+static const int ParticleGrain = 16384;
+
+// Kinematic colliders that would have to move faster than this to reach
+// their target jump there instead, e.g. when tracking picks up someone new
+static const float32 MaxKinematicSpeed = 50.0f;
+
+// User data of the kinematic collider bodies
+static char KinematicColliderTag;
+
+Simulation::Simulation(const vector<shared_ptr<SceneBase>>& scenes) : _scenes(scenes) {
+}
+
+Simulation::~Simulation() {
+	teardown();
+}
+
+void Simulation::setup(const SimulationParameters& params) {
+	Stopwatch stopwatch;
+	teardown();
+	_params = params;
+
+	// World
+	b2Vec2 gravity;
+	gravity.Set(params.gravityX, params.gravityY);
+	_world = new b2World(gravity);
+
+	// Particle System
+	const b2ParticleSystemDef particleSystemDef;
+	_particleSystem = _world->CreateParticleSystem(&particleSystemDef);
+	_particleSystem->SetGravityScale(0.4f);
+	_particleSystem->SetDensity(1.2f);
+	_particleSystem->SetRadius(params.particleSize);
+	_particleSystem->SetDamping(params.particleDamping);
+	_particleSystem->SetStuckThreshold(params.stuckThreshold);
+
+	b2BodyDef bodyDef;
+	_groundBody = _world->CreateBody(&bodyDef);
+
+	int sceneIndex = params.sceneIndex;
+	if (params.sceneHash) {
+		shared_ptr<const SceneImage> image = findScene(params.sceneHash);
+		if (image) {
+			_scene = make_shared<DataScene>(image);
+		}
+	} else if (0 <= sceneIndex && sceneIndex < (int)_scenes.size()) {
+		_scene = _scenes[sceneIndex]->create();
+	}
+	if (_scene) {
+		_scene->setup(_world, _particleSystem, params);
+	}
+	// Before attach, so the buffers start out with room for the pool
+	_emitterPool.setup(_particleSystem, params.emitterPool);
+
+	// LiquidFun keeps their buffers, their pools never make them grow
+	if (params.particleSystems) {
+		_extraSystems.resize(params.particleSystems->size());
+		for (size_t i = 0; i < _extraSystems.size(); i++) {
+			b2ParticleSystem* particleSystem = _world->CreateParticleSystem(&particleSystemDef);
+			particleSystem->SetGravityScale(0.4f);
+			particleSystem->SetDensity(1.2f);
+			particleSystem->SetRadius((*params.particleSystems)[i].radius);
+			particleSystem->SetStuckThreshold(params.stuckThreshold);
+			_extraSystems[i].particleSystem = particleSystem;
+			_extraSystems[i].pool.setup(particleSystem, (*params.particleSystems)[i].pool);
+		}
+		updateExtraSystems();
+	}
+
+	_colliderBody = _world->CreateBody(&bodyDef);
+	buildCollider();
+	placeCollider();
+	updateKinematicBodies();
+
+	_buffers.attach(_particleSystem);
+	_capacity.reset();
+	updateCapacity();
+
+	_time = 0;
+	_setupParams = params;
+	_checkpoints.clear();
+
+	// Restart goes back to the warm start state too
+	bool warmStarted = false;
+	_initialCheckpoint.emitterState.clear();
+	if (!params.warmStartFile.empty() &&
+		readStateFile(params.warmStartFile.c_str(), params, _initialCheckpoint)) {
+		_initialCheckpoint.time = 0;
+		warmStarted = restoreCheckpoint(_initialCheckpoint);
+	}
+	if (!warmStarted) {
+		saveCheckpoint(_initialCheckpoint);
+	}
+
+	_stats.initTime = stopwatch.elapsedMS();
+}
+
+void Simulation::setParameters(const SimulationParameters& params) {
+	uint32_t changed = _params.diff(params);
+	if (!changed) {
+		return;
+	}
+	wake();
+	_params = params;
+	if (!_world) {
+		return;
+	}
+
+	if (changed & ChangeGravity) {
+		_world->SetGravity(b2Vec2((float32)params.gravityX, (float32)params.gravityY));
+	}
+	if (changed & ChangeParticleDamping) {
+		_particleSystem->SetDamping((float32)params.particleDamping);
+	}
+	if (changed & ChangeParticleSize) {
+		setParticleRadius((float32)params.particleSize);
+	}
+	if (changed & ChangeCapacity) {
+		updateCapacity();
+	}
+	if (changed & ChangeCollider) {
+		buildCollider();
+	}
+	if (changed & (ChangeCollider | ChangeColliderTransform)) {
+		placeCollider();
+	}
+	if (changed & ChangeKinematic) {
+		updateKinematicBodies();
+	}
+	if (changed & ChangeStuckThreshold) {
+		_particleSystem->SetStuckThreshold(params.stuckThreshold);
+		for (ExtraSystem& extra : _extraSystems) {
+			extra.particleSystem->SetStuckThreshold(params.stuckThreshold);
+		}
+	}
+	if (changed & ChangeParticleSystems) {
+		updateExtraSystems();
+	}
+}
+
+void Simulation::updateExtraSystems() {
+	// A different number of systems only takes effect on the next setup()
+	const vector<ParticleSystemSettings>* systems = _params.particleSystems.get();
+	size_t n = systems ? b2Min(systems->size(), _extraSystems.size()) : 0;
+	for (size_t i = 0; i < n; i++) {
+		const ParticleSystemSettings& settings = (*systems)[i];
+		ExtraSystem& extra = _extraSystems[i];
+		extra.particleSystem->SetDamping(settings.damping);
+		// All its particles are pooled, the live ones are short lived
+		if (0 < settings.radius && settings.radius != extra.particleSystem->GetRadius()) {
+			extra.particleSystem->SetRadius(settings.radius);
+			extra.pool.park();
+		}
+	}
+}
+
+double Simulation::getStableTimeStep() {
+	// CFL condition: no particle may move more than courant diameters in
+	// one step. Parked pool particles don't move, so they don't count.
+	double dt = _params.maxTimeStep;
+	float speed = getMaxSpeed(_particleSystem);
+	if (0 < speed) {
+		dt = b2Min(dt, _params.courant * 2 * _particleSystem->GetRadius() / speed);
+	}
+	for (ExtraSystem& extra : _extraSystems) {
+		speed = getMaxSpeed(extra.particleSystem);
+		if (0 < speed) {
+			dt = b2Min(dt, _params.courant * 2 * extra.particleSystem->GetRadius() / speed);
+		}
+	}
+	return b2Max(dt, _params.minTimeStep);
+}
+
+int Simulation::getParticleIterations() const {
+	int iterations = b2Max(_params.particleIterations, 1);
+	const vector<ParticleSystemSettings>* systems = _params.particleSystems.get();
+	size_t n = systems ? b2Min(systems->size(), _extraSystems.size()) : 0;
+	for (size_t i = 0; i < n; i++) {
+		iterations = b2Max(iterations, (*systems)[i].iterations);
+	}
+	return iterations;
+}
+
+void Simulation::buildCollider() {
+	b2Fixture* fixture = _colliderBody->GetFixtureList();
+	while (fixture) {
+		b2Fixture* next = fixture->GetNext();
+		_colliderBody->DestroyFixture(fixture);
+		fixture = next;
+	}
+
+	const ColliderGeometry* geometry = _params.collider.get();
+	if (!geometry) {
+		return;
+	}
+	for (const ColliderPart& part : geometry->parts) {
+		const b2Vec2* vertices = geometry->vertices.data() + part.begin;
+		if (part.chain) {
+			b2ChainShape chain;
+			chain.CreateLoop(vertices, part.count);
+			_colliderBody->CreateFixture(&chain, 0.0f);
+		} else {
+			b2PolygonShape polygon;
+			polygon.Set(vertices, part.count);
+			_colliderBody->CreateFixture(&polygon, 0.0f);
+		}
+	}
+}
+
+void Simulation::placeCollider() {
+	_colliderBody->SetTransform(
+		b2Vec2((float32)_params.colliderX, (float32)_params.colliderY), (float32)_params.colliderAngle);
+}
+
+void Simulation::updateKinematicBodies() {
+	const vector<KinematicCollider>* colliders = _params.kinematicColliders.get();
+	size_t n = colliders ? colliders->size() : 0;
+	while (_kinematicBodies.size() > n) {
+		_world->DestroyBody(_kinematicBodies.back());
+		_kinematicBodies.pop_back();
+		_kinematicRadii.pop_back();
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const KinematicCollider& collider = (*colliders)[i];
+		if (i == _kinematicBodies.size()) {
+			// New ones start at their target
+			b2BodyDef bodyDef;
+			bodyDef.type = b2_kinematicBody;
+			bodyDef.position.Set(collider.x, collider.y);
+			bodyDef.angle = collider.angle;
+			bodyDef.userData = &KinematicColliderTag;
+			_kinematicBodies.push_back(_world->CreateBody(&bodyDef));
+			_kinematicRadii.push_back(-1);
+		}
+
+		// Only a new size rebuilds the fixture
+		if (_kinematicRadii[i] != collider.radius) {
+			b2Body* body = _kinematicBodies[i];
+			if (body->GetFixtureList()) {
+				body->DestroyFixture(body->GetFixtureList());
+			}
+			if (0 < collider.radius) {
+				b2CircleShape circle;
+				circle.m_radius = collider.radius;
+				body->CreateFixture(&circle, 0.0f);
+			}
+			_kinematicRadii[i] = collider.radius;
+		}
+	}
+}
+
+void Simulation::driveKinematicBodies(float32 remaining) {
+	if (_kinematicBodies.empty() || remaining <= 0) {
+		return;
+	}
+	const vector<KinematicCollider>& colliders = *_params.kinematicColliders;
+	for (size_t i = 0; i < _kinematicBodies.size(); i++) {
+		b2Body* body = _kinematicBodies[i];
+		const KinematicCollider& collider = colliders[i];
+		b2Vec2 position = body->GetPosition();
+		b2Vec2 velocity((collider.x - position.x) / remaining, (collider.y - position.y) / remaining);
+		if (velocity.LengthSquared() > MaxKinematicSpeed * MaxKinematicSpeed) {
+			body->SetTransform(b2Vec2(collider.x, collider.y), collider.angle);
+			body->SetLinearVelocity(b2Vec2(0, 0));
+			body->SetAngularVelocity(0);
+			continue;
+		}
+		body->SetLinearVelocity(velocity);
+		// The short way round, so 359 to 1 degrees turns 2 degrees. The body's
+		// angle isn't wrapped either, it adds up over the turns.
+		float32 turn = collider.angle - body->GetAngle();
+		turn -= 2 * b2_pi * floorf((turn + b2_pi) / (2 * b2_pi));
+		body->SetAngularVelocity(turn / remaining);
+	}
+}
+
+bool Simulation::isKinematicCollider(const b2Body* body) const {
+	return body->GetUserData() == &KinematicColliderTag;
+}
+
+void Simulation::setParticleRadius(float32 radius) {
+	float32 oldRadius = _particleSystem->GetRadius();
+	if (radius <= 0 || radius == oldRadius) {
+		return;
+	}
+	_particleSystem->SetRadius(radius);
+	scaleParticles(radius / oldRadius, _particleSystem->GetParticleCount());
+	_emitterPool.park();
+}
+
+void Simulation::scaleParticles(float32 scale, int count) {
+	if (count <= 0) {
+		return;
+	}
+
+	// Scale about the centroid, so the fluid grows or shrinks where it is.
+	// The emitter pool is left out, its parked particles are far away and
+	// the live ones are short lived.
+	int poolBegin = _emitterPool.getBegin();
+	int poolEnd = poolBegin + _emitterPool.getSize();
+	int scaled = count - b2Max(0, b2Min(poolEnd, count) - poolBegin);
+	if (scaled <= 0) {
+		return;
+	}
+	b2Vec2* positions = _particleSystem->GetPositionBuffer();
+	TaskExecutor& executor = getExecutor();
+	b2Vec2 sum = executor.parallelReduce(count, ParticleGrain, b2Vec2(0, 0),
+		[&](int begin, int end) {
+			b2Vec2 partial(0, 0);
+			for (int i = begin; i < end; i++) {
+				if (i < poolBegin || poolEnd <= i) {
+					partial.x += positions[i].x;
+					partial.y += positions[i].y;
+				}
+			}
+			return partial;
+		},
+		[](b2Vec2 a, const b2Vec2& b) {
+			return b2Vec2(a.x + b.x, a.y + b.y);
+		});
+	b2Vec2 center(sum.x / scaled, sum.y / scaled);
+
+	executor.parallelFor(count, ParticleGrain, [&](int chunk, int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			if (i < poolBegin || poolEnd <= i) {
+				positions[i].x = center.x + (positions[i].x - center.x) * scale;
+				positions[i].y = center.y + (positions[i].y - center.y) * scale;
+			}
+		}
+	});
+}
+
+void Simulation::teardown() {
+	delete _world;
+	_world = NULL;
+	_buffers.release();
+	_particleSystem = NULL;
+	_groundBody = NULL;
+	_colliderBody = NULL;
+	_kinematicBodies.clear();
+	_kinematicRadii.clear();
+	_emitterPool.reset();
+	_extraSystems.clear();
+	_scene = NULL;
+	_timestep.reset();
+	_governor.reset();
+	_sleep.reset();
+	_checkpoints.clear();
+	_time = 0;
+	_stats.culledZone = 0;
+	_stats.culledStuck = 0;
+}
+
+void Simulation::restart(const SimulationParameters& params) {
+	Stopwatch stopwatch;
+	if (_world && params.sameWorld(_setupParams) && restoreCheckpoint(_initialCheckpoint)) {
+		_checkpoints.clear();
+		setParameters(params);
+		_stats.initTime = stopwatch.elapsedMS();
+		return;
+	}
+	SimulationParameters copy = params;
+	setup(copy);
+}
+
+bool Simulation::rewind(double seconds) {
+	if (!_world) {
+		return false;
+	}
+
+	// Older than anything in the ring, go back to the start
+	const WorldCheckpoint* checkpoint = _checkpoints.findAtOrBefore(_time - seconds);
+	if (!checkpoint) {
+		checkpoint = &_initialCheckpoint;
+	}
+	if (!restoreCheckpoint(*checkpoint)) {
+		return false;
+	}
+	_checkpoints.dropAfter(_time);
+	return true;
+}
+
+bool Simulation::saveState(const char* path) {
+	if (!_world || !path || !*path) {
+		return false;
+	}
+	WorldCheckpoint checkpoint;
+	saveCheckpoint(checkpoint);
+	return writeStateFile(path, checkpoint, _setupParams);
+}
+
+void Simulation::updateCheckpoints() {
+	_checkpoints.setCapacity(_params.maxCheckpoints);
+	if (_params.checkpointInterval <= 0) {
+		return;
+	}
+	if (_time - _checkpoints.getNewestTime() >= _params.checkpointInterval) {
+		WorldCheckpoint* checkpoint = _checkpoints.push();
+		if (checkpoint) {
+			saveCheckpoint(*checkpoint);
+		}
+	}
+}
+
+void Simulation::saveCheckpoint(WorldCheckpoint& checkpoint) {
+	checkpoint.time = _time;
+	checkpoint.radius = _particleSystem->GetRadius();
+
+	int n = _particleSystem->GetParticleCount();
+	const b2Vec2* positions = _particleSystem->GetPositionBuffer();
+	const b2Vec2* velocities = _particleSystem->GetVelocityBuffer();
+	const uint32* flags = _particleSystem->GetFlagsBuffer();
+	checkpoint.positions.assign(positions, positions + n);
+	checkpoint.velocities.assign(velocities, velocities + n);
+	checkpoint.flags.assign(flags, flags + n);
+
+	checkpoint.groupRanges.clear();
+	for (b2ParticleGroup* g = _particleSystem->GetParticleGroupList(); g; g = g->GetNext()) {
+		checkpoint.groupRanges.push_back(g->GetBufferIndex());
+		checkpoint.groupRanges.push_back(g->GetParticleCount());
+	}
+
+	checkpoint.bodies.clear();
+	for (b2Body* body = _world->GetBodyList(); body; body = body->GetNext()) {
+		if (isKinematicCollider(body)) {
+			continue;
+		}
+		BodyState state;
+		state.position = body->GetPosition();
+		state.angle = body->GetAngle();
+		state.linearVelocity = body->GetLinearVelocity();
+		state.angularVelocity = body->GetAngularVelocity();
+		state.awake = body->IsAwake();
+		checkpoint.bodies.push_back(state);
+	}
+
+	if (_scene) {
+		_scene->saveState(checkpoint.sceneState);
+	} else {
+		checkpoint.sceneState.clear();
+	}
+	_emitterPool.saveState(checkpoint.emitterState);
+}
+
+bool Simulation::restoreCheckpoint(const WorldCheckpoint& checkpoint) {
+	// The groups and bodies have to be the ones the checkpoint was taken
+	// from. Particles outside the groups have no identity, so a different
+	// number of them is fixed up by destroying or creating some at the end.
+	size_t r = 0;
+	for (b2ParticleGroup* g = _particleSystem->GetParticleGroupList(); g; g = g->GetNext(), r += 2) {
+		if (r + 1 >= checkpoint.groupRanges.size() ||
+			checkpoint.groupRanges[r] != g->GetBufferIndex() ||
+			checkpoint.groupRanges[r + 1] != g->GetParticleCount()) {
+			return false;
+		}
+	}
+	int bodyCount = _world->GetBodyCount() - (int)_kinematicBodies.size();
+	if (r != checkpoint.groupRanges.size() || bodyCount != (int)checkpoint.bodies.size()) {
+		return false;
+	}
+
+	int n = checkpoint.getParticleCount();
+	int count = _particleSystem->GetParticleCount();
+	if (count > n) {
+		// Removed on the next step
+		for (int i = n; i < count; i++) {
+			_particleSystem->DestroyParticle(i);
+		}
+	} else if (count < n) {
+		_buffers.reserve(n - count + ParticleBuffers::MinCapacity);
+		for (int i = count; i < n; i++) {
+			b2ParticleDef def;
+			def.flags = checkpoint.flags[i];
+			def.position = checkpoint.positions[i];
+			def.velocity = checkpoint.velocities[i];
+			if (_particleSystem->CreateParticle(def) == b2_invalidParticleIndex) {
+				break;
+			}
+		}
+	}
+
+	int m = b2Min(n, _particleSystem->GetParticleCount());
+	memcpy(_particleSystem->GetPositionBuffer(), checkpoint.positions.data(), m * sizeof(b2Vec2));
+	memcpy(_particleSystem->GetVelocityBuffer(), checkpoint.velocities.data(), m * sizeof(b2Vec2));
+	float32 radius = _particleSystem->GetRadius();
+	if (0 < checkpoint.radius && checkpoint.radius != radius) {
+		// Particle Size has changed since
+		scaleParticles(radius / checkpoint.radius, m);
+	}
+	const uint32* flags = _particleSystem->GetFlagsBuffer();
+	for (int i = 0; i < m; i++) {
+		if (flags[i] != checkpoint.flags[i]) {
+			_particleSystem->SetParticleFlags(i, checkpoint.flags[i]);
+		}
+	}
+
+	int i = 0;
+	for (b2Body* body = _world->GetBodyList(); body; body = body->GetNext()) {
+		if (isKinematicCollider(body)) {
+			continue;
+		}
+		const BodyState& state = checkpoint.bodies[i++];
+		body->SetTransform(state.position, state.angle);
+		body->SetLinearVelocity(state.linearVelocity);
+		body->SetAngularVelocity(state.angularVelocity);
+		body->SetAwake(state.awake);
+	}
+	// The collider follows the SOP, not the checkpoint
+	placeCollider();
+
+	if (_scene) {
+		_scene->restoreState(checkpoint.sceneState);
+	}
+	_emitterPool.restoreState(checkpoint.emitterState);
+	static const vector<char> parkAll;
+	for (ExtraSystem& extra : _extraSystems) {
+		extra.pool.restoreState(parkAll);
+	}
+
+	_time = checkpoint.time;
+	_timestep.reset();
+	wake();
+	updateCapacity();
+	return true;
+}
+
+int Simulation::step(double elapsed) {
+	if (!_world) {
+		return 0;
+	}
+
+	// The full quality settings, or fewer iterations and substeps while the
+	// governor is holding frames to the budget
+	SolverSettings full = { _params.velocityIterations, _params.positionIterations,
+		getParticleIterations(), _params.maxSubsteps };
+	SolverSettings minimum = { _params.minVelocityIterations, _params.minPositionIterations,
+		_params.minParticleIterations, _params.minSubsteps };
+	if (!_params.governor) {
+		_governor.reset();
+	}
+	SolverSettings solver = _governor.apply(full, minimum);
+	Stopwatch frameStopwatch;
+
+	// Step the world at a fixed rate, as many times as the elapsed time needs,
+	// or in adaptive mode in steps sized to the fastest particle
+	bool adaptive = _params.adaptiveTimestep;
+	double dt = _params.getTimeStep();
+	int substeps = 0;
+	if (adaptive) {
+		_timestep.accumulate(elapsed);
+	} else {
+		substeps = _timestep.advance(elapsed, dt, solver.maxSubsteps);
+	}
+	_stats.stepTime = 0;
+	_stats.updateTime = 0;
+	for (int i = 0; ; i++) {
+		double remaining;
+		if (adaptive) {
+			// The reduction is skipped once what's left waits for the next cook
+			double stableDt = _timestep.getAccumulator() < _params.minTimeStep ? _params.maxTimeStep : getStableTimeStep();
+			dt = _timestep.next(stableDt, _params.minTimeStep, solver.maxSubsteps);
+			if (dt <= 0) {
+				break;
+			}
+			remaining = dt + _timestep.getAccumulator();
+		} else {
+			if (substeps <= i) {
+				break;
+			}
+			remaining = (substeps - i) * dt;
+		}
+		_stats.timeStep = dt;
+
+		// Keep room for new particles so CreateParticle never hits the capacity
+		_buffers.reserveStep();
+
+		// Kinematic colliders reach their targets by the end of the frame
+		driveKinematicBodies((float32)remaining);
+
+		Stopwatch stopwatch;
+		applyForceField(_particleSystem, (float32)dt);
+		for (ExtraSystem& extra : _extraSystems) {
+			applyForceField(extra.particleSystem, (float32)dt);
+		}
+		_world->Step(dt, solver.velocityIterations, solver.positionIterations, solver.particleIterations);
+		_stats.stepTime += stopwatch.elapsedMS();
+
+		if (_scene) {
+			stopwatch.restart();
+			_scene->update(dt);
+			_stats.updateTime += stopwatch.elapsedMS();
+		}
+
+		cullParticles(_particleSystem, _emitterPool);
+		for (ExtraSystem& extra : _extraSystems) {
+			cullParticles(extra.particleSystem, extra.pool);
+		}
+
+		// Spawned between steps, so the new particles go out with the output
+		static const vector<Emitter> noEmitters;
+		const vector<Emitter>& emitters = _params.emitters ? *_params.emitters : noEmitters;
+		_emitterPool.update(emitters, 0, _time + dt, (float32)dt);
+		for (size_t s = 0; s < _extraSystems.size(); s++) {
+			_extraSystems[s].pool.update(emitters, (int)s + 1, _time + dt, (float32)dt);
+		}
+
+		updateSleep(dt);
+
+		_time += dt;
+		updateCheckpoints();
+	}
+	substeps = _timestep.getSubsteps();
+
+	updateCapacity();
+
+	// Cooks without a step say nothing about the cost
+	if (_params.governor && 0 < substeps) {
+		_governor.update(frameStopwatch.elapsedMS(), _params.frameBudget, full, minimum);
+	}
+	_stats.governorLevel = _governor.getLevel();
+	_stats.governorTime = _governor.getAverage();
+	_stats.velocityIterations = solver.velocityIterations;
+	_stats.positionIterations = solver.positionIterations;
+	_stats.particleIterations = solver.particleIterations;
+	_stats.maxSubsteps = solver.maxSubsteps;
+	return substeps;
+}
+
+void Simulation::cullParticles(b2ParticleSystem* particleSystem, EmitterPool& pool) {
+	int count = particleSystem->GetParticleCount();
+	const vector<KillZone>* zones = _params.killZones.get();
+	bool hasZones = zones && !zones->empty();
+	if (count > 0 && (hasZones || _params.cullOutside)) {
+		b2Vec2 lower((float32)(_params.boundsCenterX - _params.boundsSizeX / 2),
+			(float32)(_params.boundsCenterY - _params.boundsSizeY / 2));
+		b2Vec2 upper((float32)(_params.boundsCenterX + _params.boundsSizeX / 2),
+			(float32)(_params.boundsCenterY + _params.boundsSizeY / 2));
+		bool cullOutside = _params.cullOutside;
+		int poolBegin = pool.getBegin();
+		int poolEnd = poolBegin + pool.getSize();
+		const b2Vec2* positions = particleSystem->GetPositionBuffer();
+
+		// Every chunk collects into its own list, which keeps its capacity
+		_cullChunks.resize(TaskExecutor::getNumChunks(count, ParticleGrain));
+		getExecutor().parallelFor(count, ParticleGrain, [&](int chunk, int begin, int end) {
+			vector<int32>& culled = _cullChunks[chunk];
+			culled.clear();
+			for (int i = begin; i < end; i++) {
+				const b2Vec2& p = positions[i];
+				bool kill = cullOutside && (p.x < lower.x || p.y < lower.y || upper.x < p.x || upper.y < p.y);
+				for (size_t z = 0; !kill && hasZones && z < zones->size(); z++) {
+					const KillZone& zone = (*zones)[z];
+					kill = zone.minX <= p.x && p.x <= zone.maxX && zone.minY <= p.y && p.y <= zone.maxY;
+				}
+				// Parked pool particles are meant to be out of the way
+				if (kill && (i < poolBegin || poolEnd <= i || pool.isAlive(i))) {
+					culled.push_back(i);
+				}
+			}
+		});
+		for (const vector<int32>& culled : _cullChunks) {
+			for (int32 index : culled) {
+				cull(particleSystem, pool, index, _stats.culledZone);
+			}
+		}
+	}
+
+	if (0 < _params.stuckThreshold) {
+		// Candidates of the last step, wall particles are meant to stay put
+		const int32* stuck = particleSystem->GetStuckCandidates();
+		int numStuck = particleSystem->GetStuckCandidateCount();
+		const uint32* flags = particleSystem->GetFlagsBuffer();
+		for (int i = 0; i < numStuck; i++) {
+			int32 index = stuck[i];
+			if (index < count && !(flags[index] & b2_wallParticle)) {
+				cull(particleSystem, pool, index, _stats.culledStuck);
+			}
+		}
+	}
+}
+
+void Simulation::cull(b2ParticleSystem* particleSystem, EmitterPool& pool, int32 index, int& counter) {
+	if (pool.isPooled(index)) {
+		if (pool.isAlive(index)) {
+			pool.retire(index);
+			counter++;
+		}
+	} else if (!(particleSystem->GetFlagsBuffer()[index] & b2_zombieParticle)) {
+		// Removed on the next step
+		particleSystem->DestroyParticle(index);
+		counter++;
+	}
+}
+
+void Simulation::applyForceField(b2ParticleSystem* particleSystem, float32 dt) {
+	const ForceField* force = _params.forceField.get();
+	int count = particleSystem->GetParticleCount();
+	if (!force || count == 0 || _params.forceSizeX <= 0 || _params.forceSizeY <= 0) {
+		return;
+	}
+
+	VectorField field;
+	field.texels = force->texels.data();
+	field.width = force->width;
+	field.height = force->height;
+	field.originX = (float)(_params.forceCenterX - _params.forceSizeX / 2);
+	field.originY = (float)(_params.forceCenterY - _params.forceSizeY / 2);
+	field.scaleX = (float)(force->width / _params.forceSizeX);
+	field.scaleY = (float)(force->height / _params.forceSizeY);
+	float scale = (float)(_params.forceScale * dt);
+
+	// LiquidFun's force buffer is private and ParticleApplyForce isn't
+	// thread safe, so the field goes straight into the velocities
+	const b2Vec2* positions = particleSystem->GetPositionBuffer();
+	b2Vec2* velocities = particleSystem->GetVelocityBuffer();
+	const SimdKernels& kernels = getKernels();
+	getExecutor().parallelFor(count, ParticleGrain, [&](int chunk, int begin, int end) {
+		kernels.addField(positions + begin, velocities + begin, end - begin, field, scale);
+	});
+}
+
+void Simulation::updateSleep(float dt) {
+	if (!_params.particleSleep) {
+		wake();
+		return;
+	}
+
+	// Anything that can push the particles wakes them up
+	int count = _particleSystem->GetParticleCount();
+	if (count != _sleepParticleCount || hasAwakeBodies() || _params.forceField ||
+		0 < _emitterPool.getAliveCount() ||
+		(0 < _emitterPool.getSize() && _params.emitters && !_params.emitters->empty())) {
+		_sleepParticleCount = count;
+		wake();
+		return;
+	}
+
+	if (!_particleSystem->GetPaused() && _sleep.update(getMaxParticleSpeed(), dt, _params.sleepSkin)) {
+		_particleSystem->SetPaused(true);
+	}
+}
+
+bool Simulation::hasAwakeBodies() const {
+	for (b2Body* body = _world->GetBodyList(); body; body = body->GetNext()) {
+		if (body->GetType() != b2_staticBody && body->IsAwake()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Simulation::isSleeping() const {
+	return _particleSystem && _particleSystem->GetPaused();
+}
+
+void Simulation::wake() {
+	_sleep.reset();
+	if (_particleSystem) {
+		_particleSystem->SetPaused(false);
+	}
+}
+
+SimulationStats Simulation::getStats() const {
+	SimulationStats stats = _stats;
+	if (_particleSystem) {
+		stats.particles = _particleSystem->GetParticleCount();
+		stats.contacts = _particleSystem->GetContactCount();
+		stats.bodyContacts = _particleSystem->GetBodyContactCount();
+	}
+	stats.bufferBytes = _buffers.getAllocatedBytes();
+	stats.buffersFull = _buffers.getFullCount();
+	stats.emitterParticles = _emitterPool.getAliveCount();
+	stats.emitterDropped = _emitterPool.getDroppedCount();
+	for (const ExtraSystem& extra : _extraSystems) {
+		stats.particles += extra.particleSystem->GetParticleCount();
+		stats.contacts += extra.particleSystem->GetContactCount();
+		stats.bodyContacts += extra.particleSystem->GetBodyContactCount();
+		stats.emitterParticles += extra.pool.getAliveCount();
+		stats.emitterDropped += extra.pool.getDroppedCount();
+	}
+	return stats;
+}
+
+int Simulation::getParticleCount() const {
+	return _particleSystem ? _particleSystem->GetParticleCount() : 0;
+}
+
+int Simulation::getOutputLength() const {
+	int length = getParticleCount();
+	if (_params.fixedCapacity && _particleSystem) {
+		length = _capacity.getCapacity();
+	}
+	// The blocks of the extra systems share it, the shorter ones are padded
+	for (const ExtraSystem& extra : _extraSystems) {
+		length = b2Max(length, (int)extra.particleSystem->GetParticleCount());
+	}
+	return length;
+}
+
+void Simulation::updateCapacity() {
+	if (!_particleSystem) {
+		return;
+	}
+
+	int count = _particleSystem->GetParticleCount();
+	if (!_params.fixedCapacity) {
+		_capacity.reset();
+		_particleSystem->SetMaxParticleCount(0);
+		return;
+	}
+
+	int capacity = _capacity.update(count, _params.maxParticles, _params.autoGrow);
+	if (_params.autoGrow) {
+		// The capacity follows the particles instead
+		_particleSystem->SetMaxParticleCount(0);
+	} else if (count > capacity) {
+		// The capacity was lowered below the particle count, drop the particles
+		// past the end. They're removed on the next step. The pool's
+		// particles stay, EmitterPool expects its group to keep its size, so
+		// the capacity can't go below the pool.
+		int excess = count - capacity;
+		for (int i = count - 1; 0 <= i && 0 < excess; i--) {
+			if (!_emitterPool.isPooled(i)) {
+				_particleSystem->DestroyParticle(i);
+				excess--;
+			}
+		}
+		_particleSystem->SetMaxParticleCount(count);
+	} else {
+		_particleSystem->SetMaxParticleCount(capacity);
+	}
+}
+
+float Simulation::getMaxParticleSpeed() {
+	return _particleSystem ? getMaxSpeed(_particleSystem) : 0;
+}
+
+float Simulation::getMaxSpeed(b2ParticleSystem* particleSystem) {
+	int n = particleSystem->GetParticleCount();
+	if (n == 0) {
+		return 0;
+	}
+
+	const b2Vec2* velocities = particleSystem->GetVelocityBuffer();
+	const SimdKernels& kernels = getKernels();
+	float maxSpeedSquared = getExecutor().parallelReduce(n, ParticleGrain, 0.0f,
+		[&](int begin, int end) {
+			return kernels.maxLengthSquared(velocities + begin, end - begin);
+		},
+		[](float a, float b) {
+			return a > b ? a : b;
+		});
+	return sqrtf(maxSpeedSquared);
+}
+
+// Per-particle buffers every particle system keeps: position, velocity,
+// flags, group and the solver's accumulation buffer
+static const size_t ParticleBytes = 2 * sizeof(b2Vec2) + sizeof(uint32) + sizeof(b2ParticleGroup*) + sizeof(float32);
+
+// Running totals of one group over a chunk of particles
+struct GroupAccumulator {
+	int count = 0;
+	double sumX = 0;
+	double sumY = 0;
+	double sumSpeed = 0;
+	float minX = b2_maxFloat;
+	float minY = b2_maxFloat;
+	float maxX = -b2_maxFloat;
+	float maxY = -b2_maxFloat;
+	float maxSpeed = 0;
+
+	void combine(const GroupAccumulator& o) {
+		count += o.count;
+		sumX += o.sumX;
+		sumY += o.sumY;
+		sumSpeed += o.sumSpeed;
+		minX = b2Min(minX, o.minX);
+		minY = b2Min(minY, o.minY);
+		maxX = b2Max(maxX, o.maxX);
+		maxY = b2Max(maxY, o.maxY);
+		maxSpeed = b2Max(maxSpeed, o.maxSpeed);
+	}
+};
+
+void Simulation::computeWorldStats(vector<WorldStatsRow>& rows) {
+	rows.clear();
+	if (!_world) {
+		return;
+	}
+
+	// One block of group rows per particle system
+	computeSystemStats(_particleSystem, _emitterPool, 0, rows);
+	for (size_t s = 0; s < _extraSystems.size(); s++) {
+		computeSystemStats(_extraSystems[s].particleSystem, _extraSystems[s].pool, (int)s + 1, rows);
+	}
+
+	// Bodies
+	unordered_map<const b2Body*, size_t> bodyRows;
+	int index = 0;
+	for (b2Body* body = _world->GetBodyList(); body; body = body->GetNext(), index++) {
+		WorldStatsRow row;
+		row.kind = WorldStatsRow::Kind::Body;
+		row.index = index;
+		row.centroidX = body->GetWorldCenter().x;
+		row.centroidY = body->GetWorldCenter().y;
+		bool hasAABB = false;
+		for (b2Fixture* f = body->GetFixtureList(); f; f = f->GetNext()) {
+			for (int child = 0; child < f->GetShape()->GetChildCount(); child++) {
+				const b2AABB& aabb = f->GetAABB(child);
+				row.minX = hasAABB ? b2Min(row.minX, aabb.lowerBound.x) : aabb.lowerBound.x;
+				row.minY = hasAABB ? b2Min(row.minY, aabb.lowerBound.y) : aabb.lowerBound.y;
+				row.maxX = hasAABB ? b2Max(row.maxX, aabb.upperBound.x) : aabb.upperBound.x;
+				row.maxY = hasAABB ? b2Max(row.maxY, aabb.upperBound.y) : aabb.upperBound.y;
+				hasAABB = true;
+			}
+		}
+		row.meanSpeed = row.maxSpeed = body->GetLinearVelocity().Length();
+		row.flags = body->GetType();
+		bodyRows[body] = rows.size();
+		rows.push_back(row);
+	}
+	for (b2ParticleSystem* particleSystem = _world->GetParticleSystemList(); particleSystem;
+		particleSystem = particleSystem->GetNext()) {
+		const b2ParticleBodyContact* contacts = particleSystem->GetBodyContacts();
+		for (int i = 0; i < particleSystem->GetBodyContactCount(); i++) {
+			auto it = bodyRows.find(contacts[i].body);
+			if (it != bodyRows.end()) {
+				rows[it->second].particles++;
+			}
+		}
+	}
+}
+
+void Simulation::computeSystemStats(b2ParticleSystem* particleSystem, const EmitterPool& pool, int system,
+	vector<WorldStatsRow>& rows) {
+	// Groups own contiguous index ranges, sorted here by start so a chunk can
+	// walk them alongside its particles. Particles outside all ranges go to
+	// the last slot.
+	struct Range {
+		int begin;
+		int end;
+		int slot;
+	};
+	vector<Range> ranges;
+	vector<b2ParticleGroup*> groups;
+	for (b2ParticleGroup* g = particleSystem->GetParticleGroupList(); g; g = g->GetNext()) {
+		Range range = { g->GetBufferIndex(), g->GetBufferIndex() + g->GetParticleCount(), (int)groups.size() };
+		ranges.push_back(range);
+		groups.push_back(g);
+	}
+	sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+	int numSlots = (int)groups.size() + 1;
+	int ungrouped = numSlots - 1;
+
+	const b2Vec2* positions = particleSystem->GetPositionBuffer();
+	const b2Vec2* velocities = particleSystem->GetVelocityBuffer();
+	vector<GroupAccumulator> totals = getExecutor().parallelReduce(particleSystem->GetParticleCount(), ParticleGrain,
+		vector<GroupAccumulator>(numSlots),
+		[&](int begin, int end) {
+			vector<GroupAccumulator> partial(numSlots);
+			size_t r = lower_bound(ranges.begin(), ranges.end(), begin,
+				[](const Range& range, int i) { return range.end <= i; }) - ranges.begin();
+			for (int i = begin; i < end; i++) {
+				while (r < ranges.size() && ranges[r].end <= i) {
+					r++;
+				}
+				// Parked pool particles sit far below the scene
+				if (pool.isPooled(i) && !pool.isAlive(i)) {
+					continue;
+				}
+				int slot = r < ranges.size() && ranges[r].begin <= i ? ranges[r].slot : ungrouped;
+				GroupAccumulator& a = partial[slot];
+				const b2Vec2& p = positions[i];
+				float speed = sqrtf(velocities[i].x * velocities[i].x + velocities[i].y * velocities[i].y);
+				a.count++;
+				a.sumX += p.x;
+				a.sumY += p.y;
+				a.sumSpeed += speed;
+				a.minX = b2Min(a.minX, p.x);
+				a.minY = b2Min(a.minY, p.y);
+				a.maxX = b2Max(a.maxX, p.x);
+				a.maxY = b2Max(a.maxY, p.y);
+				a.maxSpeed = b2Max(a.maxSpeed, speed);
+			}
+			return partial;
+		},
+		[](vector<GroupAccumulator> a, const vector<GroupAccumulator>& b) {
+			for (size_t i = 0; i < a.size(); i++) {
+				a[i].combine(b[i]);
+			}
+			return a;
+		});
+
+	for (int slot = 0; slot < numSlots; slot++) {
+		const GroupAccumulator& a = totals[slot];
+		if (slot == ungrouped && a.count == 0) {
+			continue;
+		}
+		WorldStatsRow row;
+		row.kind = slot == ungrouped ? WorldStatsRow::Kind::Ungrouped : WorldStatsRow::Kind::Group;
+		row.system = system;
+		row.index = slot;
+		row.particles = a.count;
+		if (0 < a.count) {
+			row.centroidX = (float)(a.sumX / a.count);
+			row.centroidY = (float)(a.sumY / a.count);
+			row.minX = a.minX;
+			row.minY = a.minY;
+			row.maxX = a.maxX;
+			row.maxY = a.maxY;
+			row.meanSpeed = (float)(a.sumSpeed / a.count);
+			row.maxSpeed = a.maxSpeed;
+		}
+		row.flags = slot == ungrouped ? 0 : groups[slot]->GetGroupFlags();
+		// Parked particles take up memory all the same
+		row.bytes = (slot == ungrouped ? a.count : groups[slot]->GetParticleCount()) * ParticleBytes;
+		rows.push_back(row);
+	}
+}
+
+TaskExecutor& Simulation::getExecutor() {
+	if (_borrowedExecutor) {
+		return *_borrowedExecutor;
+	}
+	if (!_executor || _executorThreads != _params.numThreads) {
+		_executor.reset(new TaskExecutor(_params.numThreads));
+		_executorThreads = _params.numThreads;
+	}
+	return *_executor;
+}
+
+void Simulation::borrowExecutor(TaskExecutor* executor) {
+	_borrowedExecutor = executor;
+	if (executor) {
+		// Its threads would only sit idle
+		_executor.reset();
+		_executorThreads = -1;
+	}
+}
+
+void Simulation::writeChannels(float* const* channels, int numSamples) {
+	int perSystem = ::getNumChannels(_params.channelMask);
+	writeSystemChannels(_particleSystem, _emitterPool, channels, numSamples);
+	for (size_t s = 0; s < _extraSystems.size(); s++) {
+		const ExtraSystem& extra = _extraSystems[s];
+		writeSystemChannels(extra.particleSystem, extra.pool, channels + (s + 1) * perSystem, numSamples);
+	}
+}
+
+void Simulation::writeSystemChannels(b2ParticleSystem* particleSystem, const EmitterPool& pool,
+	float* const* channels, int numSamples) {
+	int n = particleSystem ? particleSystem->GetParticleCount() : 0;
+	if (n > numSamples) {
+		// Particles created while stepping show up on the next cook
+		n = numSamples;
+	}
+
+	int c = 0;
+	for (int i = 0; i < NumParticleAttributes; i++) {
+		const ParticleAttributeInfo& info = ParticleAttributes[i];
+		if (!(_params.channelMask & info.attribute)) {
+			continue;
+		}
+		if (0 < n) {
+			writeAttribute(particleSystem, pool, info.attribute, channels + c, n);
+		}
+		for (int j = 0; j < info.numChannels; j++, c++) {
+			// Parked emitter particles are empty slots too
+			int poolBegin = pool.getBegin();
+			if (info.attribute == AttributePosition) {
+				for (int i = n; i < numSamples; i++) {
+					channels[c][i] = DeadSlotPosition;
+				}
+				for (int slot : pool.getFreeSlots()) {
+					if (poolBegin + slot < n) {
+						channels[c][poolBegin + slot] = DeadSlotPosition;
+					}
+				}
+			} else {
+				memset(channels[c] + n, 0, (numSamples - n) * sizeof(float));
+				for (int slot : pool.getFreeSlots()) {
+					if (poolBegin + slot < n) {
+						channels[c][poolBegin + slot] = 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+void Simulation::writeAttribute(b2ParticleSystem* particleSystem, const EmitterPool& pool,
+	ParticleAttribute attribute, float* const* channels, int n) {
+	TaskExecutor& executor = getExecutor();
+	const SimdKernels& kernels = getKernels();
+
+	switch (attribute) {
+	case AttributePosition: {
+		const b2Vec2* positions = particleSystem->GetPositionBuffer();
+		executor.parallelFor(n, ParticleGrain, [&](int chunk, int begin, int end) {
+			kernels.deinterleave(positions + begin, channels[0] + begin, channels[1] + begin, end - begin);
+		});
+		break;
+	}
+	case AttributeVelocity: {
+		const b2Vec2* velocities = particleSystem->GetVelocityBuffer();
+		executor.parallelFor(n, ParticleGrain, [&](int chunk, int begin, int end) {
+			kernels.deinterleave(velocities + begin, channels[0] + begin, channels[1] + begin, end - begin);
+		});
+		break;
+	}
+	case AttributeColor: {
+		const b2ParticleColor* colors = particleSystem->GetColorBuffer();
+		executor.parallelFor(n, ParticleGrain, [&](int chunk, int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				channels[0][i] = colors[i].r / 255.0f;
+				channels[1][i] = colors[i].g / 255.0f;
+				channels[2][i] = colors[i].b / 255.0f;
+				channels[3][i] = colors[i].a / 255.0f;
+			}
+		});
+		break;
+	}
+	case AttributeWeight: {
+		const float32* weights = particleSystem->GetWeightBuffer();
+		memcpy(channels[0], weights, n * sizeof(float));
+		break;
+	}
+	case AttributeGroup: {
+		// Group particles are contiguous, so fill ranges instead of looking up
+		// every particle's group
+		float* group = channels[0];
+		for (int i = 0; i < n; i++) {
+			group[i] = -1;
+		}
+		int index = 0;
+		for (b2ParticleGroup* g = particleSystem->GetParticleGroupList(); g; g = g->GetNext(), index++) {
+			int begin = g->GetBufferIndex();
+			int end = b2Min(begin + g->GetParticleCount(), n);
+			for (int i = begin; i < end; i++) {
+				group[i] = (float)index;
+			}
+		}
+		break;
+	}
+	case AttributeFlags: {
+		const uint32* flags = particleSystem->GetFlagsBuffer();
+		executor.parallelFor(n, ParticleGrain, [&](int chunk, int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				channels[0][i] = (float)flags[i];
+			}
+		});
+		break;
+	}
+	case AttributeLifetime: {
+		// Remaining lifetime in seconds, 0 for particles that live forever
+		const int32* expirationTimes = particleSystem->GetExpirationTimeBuffer();
+		if (expirationTimes) {
+			for (int i = 0; i < n; i++) {
+				float lifetime = particleSystem->ExpirationTimeToLifetime(expirationTimes[i]);
+				channels[0][i] = lifetime > 0 ? lifetime : 0;
+			}
+		} else {
+			memset(channels[0], 0, n * sizeof(float));
+		}
+		// Emitted particles keep their lifetimes in the pool, not in LiquidFun
+		const vector<double>& expirations = pool.getExpirations();
+		int poolBegin = pool.getBegin();
+		int poolEnd = b2Min(poolBegin + pool.getSize(), n);
+		for (int i = poolBegin; i < poolEnd; i++) {
+			double expiration = expirations[i - poolBegin];
+			if (0 <= expiration) {
+				channels[0][i] = (float)(expiration - _time);
+			}
+		}
+		break;
+	}
+	case AttributeActive: {
+		// Destroyed particles stay in the buffers until the next step
+		const uint32* flags = particleSystem->GetFlagsBuffer();
+		executor.parallelFor(n, ParticleGrain, [&](int chunk, int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				channels[0][i] = (flags[i] & b2_zombieParticle) ? 0.0f : 1.0f;
+			}
+		});
+		break;
+	}
+	}
+}
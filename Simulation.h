@@ -0,0 +1,193 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "Box2D/Box2D.h"
+#include "SceneBase.h"
+#include "SimulationParameters.h"
+#include "FixedTimestep.h"
+#include "FrameGovernor.h"
+#include "TaskExecutor.h"
+#include "SimdKernels.h"
+#include "ParticleSleep.h"
+#include "ParticleBuffers.h"
+#include "OutputCapacity.h"
+#include "SimulationStats.h"
+#include "WorldStats.h"
+#include "WorldCheckpoint.h"
+#include "EmitterPool.h"
+
+using namespace std;
+
+// Owns the b2World of one CHOP and everything that steps it. Only one thread
+// may use a Simulation at a time: the cook thread, the SimulationThread
+// while async mode is on, or the SimulationBuilder while it sets it up.
+class Simulation {
+public:
+	Simulation(const vector<shared_ptr<SceneBase>>& scenes);
+	~Simulation();
+
+	// Builds the world and the scene selected in params, then loads the warm
+	// start file if there is one for this world
+	void setup(const SimulationParameters& params);
+	void teardown();
+	// Puts the world back to how setup() left it. The checkpoint taken after
+	// setup is restored if params build the same world, otherwise the world
+	// is rebuilt.
+	void restart(const SimulationParameters& params);
+	void restart() { restart(_params); }
+	// Jumps back to the newest periodic checkpoint at least 'seconds' old.
+	// Returns false if the world has changed too much to restore it.
+	bool rewind(double seconds);
+	// Simulated seconds since setup
+	double getTime() const { return _time; }
+
+	// Writes the current state to a file setup() can warm start from
+	bool saveState(const char* path);
+	bool isInitialized() const { return _world != NULL; }
+
+	// Applies what changed since the last call on the cheapest path. Changes
+	// to the world itself (ChangeWorld) only take effect on the next setup().
+	void setParameters(const SimulationParameters& params);
+	const SimulationParameters& getParameters() const { return _params; }
+	// Parameters the world was built with
+	const SimulationParameters& getSetupParameters() const { return _setupParams; }
+
+	// Advances the simulation by 'elapsed' seconds of real time.
+	// Returns the number of substeps taken.
+	int step(double elapsed);
+
+	int getParticleCount() const;
+	// Samples to output: the particle count, or the capacity in fixed
+	// capacity mode
+	int getOutputLength() const;
+	// Of the main particle system
+	float getMaxParticleSpeed();
+
+	// True while a settled particle system is paused, see ParticleSleep
+	bool isSleeping() const;
+	// Resumes a sleeping particle system, e.g. after pushing it from outside
+	void wake();
+
+	// Writes the attributes in the channel mask into 'channels', numSamples
+	// long each, one block per particle system. Attributes outside the mask
+	// aren't touched at all. Samples past the particle count are empty slots:
+	// positions are parked at DeadSlotPosition and everything else is zeroed.
+	void writeChannels(float* const* channels, int numSamples);
+	int getNumChannels() const { return ::getNumChannels(_params.channelMask) * getNumParticleSystems(); }
+	// The main one and the extra ones it was built with
+	int getNumParticleSystems() const { return 1 + (int)_extraSystems.size(); }
+
+	b2World* getWorld() const { return _world; }
+	b2ParticleSystem* getParticleSystem() const { return _particleSystem; }
+	const ParticleBuffers& getBuffers() const { return _buffers; }
+	const FixedTimestep& getTimestep() const { return _timestep; }
+
+	// Phase times of the last step()/setup() and the current counts
+	SimulationStats getStats() const;
+
+	// Fills one row per particle group, one for the ungrouped particles if
+	// there are any, for every particle system, then one per body. The
+	// particles are visited in a single parallel pass per system, so only
+	// call this when someone looks at it.
+	void computeWorldStats(vector<WorldStatsRow>& rows);
+
+	// Thread pool for the per-particle passes: the borrowed one, otherwise
+	// its own sized by the Threads parameter
+	TaskExecutor& getExecutor();
+	// Uses 'executor' instead of its own pool until called with NULL, e.g.
+	// the SimulationService's shared one
+	void borrowExecutor(TaskExecutor* executor);
+
+	// Per-particle kernels for the Simd parameter and this CPU
+	const SimdKernels& getKernels() const { return getSimdKernels(_params.simdLevel); }
+
+private:
+	b2World* _world = NULL;
+	b2ParticleSystem* _particleSystem = NULL;
+	b2Body* _groundBody = NULL;
+	// Always there, so the body list checkpoints were taken from stays the
+	// same; only its fixtures change with the Collider SOP
+	b2Body* _colliderBody = NULL;
+	void buildCollider();
+	void placeCollider();
+
+	// One per KinematicCollider. They follow the CHOP rather than the
+	// checkpoints, so checkpoints leave them out.
+	vector<b2Body*> _kinematicBodies;
+	vector<float> _kinematicRadii;
+	void updateKinematicBodies();
+	// Sets the velocities that get the bodies to their targets in
+	// 'remaining' seconds
+	void driveKinematicBodies(float32 remaining);
+	bool isKinematicCollider(const b2Body* body) const;
+	ParticleBuffers _buffers;
+
+	const vector<shared_ptr<SceneBase>>& _scenes;
+	shared_ptr<SceneBase> _scene;
+
+	SimulationParameters _params;
+	FixedTimestep _timestep;
+	FrameGovernor _governor;
+	SimulationStats _stats;
+	unique_ptr<TaskExecutor> _executor;
+	int _executorThreads = -1;
+	TaskExecutor* _borrowedExecutor = NULL;
+
+	EmitterPool _emitterPool;
+
+	// Particle system from the Systems CHOP. Its particles all come from its
+	// pool; checkpoints leave them out and park them all on restore.
+	struct ExtraSystem {
+		b2ParticleSystem* particleSystem = NULL;
+		EmitterPool pool;
+	};
+	vector<ExtraSystem> _extraSystems;
+	void updateExtraSystems();
+	// LiquidFun solves every particle system with the same iterations, so
+	// the world gets the highest any of them asks for
+	int getParticleIterations() const;
+	// Longest step that keeps every particle system within the Courant
+	// number, clamped to the time step bounds
+	double getStableTimeStep();
+	float getMaxSpeed(b2ParticleSystem* particleSystem);
+
+	// Culls what is in the kill zones, outside the bounds or stuck in one
+	// batch: pooled particles go back to the pool, others are destroyed
+	void cullParticles(b2ParticleSystem* particleSystem, EmitterPool& pool);
+	vector<vector<int32>> _cullChunks;
+	void cull(b2ParticleSystem* particleSystem, EmitterPool& pool, int32 index, int& counter);
+
+	// Adds the Force TOP's field to the particle velocities for one step
+	void applyForceField(b2ParticleSystem* particleSystem, float32 dt);
+
+	ParticleSleep _sleep;
+	int _sleepParticleCount = 0;
+	void updateSleep(float dt);
+	bool hasAwakeBodies() const;
+
+	// One block of writeChannels()
+	void writeSystemChannels(b2ParticleSystem* particleSystem, const EmitterPool& pool,
+		float* const* channels, int numSamples);
+	// Group rows of one particle system, leaving out parked pool particles
+	void computeSystemStats(b2ParticleSystem* particleSystem, const EmitterPool& pool, int system,
+		vector<WorldStatsRow>& rows);
+	void writeAttribute(b2ParticleSystem* particleSystem, const EmitterPool& pool,
+		ParticleAttribute attribute, float* const* channels, int n);
+
+	OutputCapacity _capacity;
+	void updateCapacity();
+
+	// Changes the particle radius, spreading the particles out or pulling
+	// them together so they keep the same packing
+	void setParticleRadius(float32 radius);
+	void scaleParticles(float32 scale, int count);
+
+	double _time = 0;
+	SimulationParameters _setupParams;
+	WorldCheckpoint _initialCheckpoint;
+	CheckpointRing _checkpoints;
+	void updateCheckpoints();
+	void saveCheckpoint(WorldCheckpoint& checkpoint);
+	bool restoreCheckpoint(const WorldCheckpoint& checkpoint);
+};
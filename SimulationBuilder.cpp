@@ -0,0 +1,45 @@
+#include "SimulationBuilder.h"
+
+SimulationBuilder::SimulationBuilder(const vector<shared_ptr<SceneBase>>& scenes) : _scenes(scenes) {
+}
+
+SimulationBuilder::~SimulationBuilder() {
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+}
+
+void SimulationBuilder::start(const SimulationParameters& params) {
+	if (_thread.joinable() && !_done) {
+		_pendingParams = params;
+		_hasPending = true;
+		return;
+	}
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+	_result.reset();
+	_hasPending = false;
+	_done = false;
+	_thread = thread(&SimulationBuilder::run, this, params);
+}
+
+unique_ptr<Simulation> SimulationBuilder::take() {
+	if (!_thread.joinable() || !_done) {
+		return NULL;
+	}
+	_thread.join();
+	if (_hasPending) {
+		// Outdated, build the newest parameters instead
+		start(_pendingParams);
+		return NULL;
+	}
+	return move(_result);
+}
+
+void SimulationBuilder::run(SimulationParameters params) {
+	unique_ptr<Simulation> simulation(new Simulation(_scenes));
+	simulation->setup(params);
+	_result = move(simulation);
+	_done = true;
+}
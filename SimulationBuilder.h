@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Simulation.h"
+
+using namespace std;
+
+// Sets up a new Simulation on a background thread, so building a large
+// scene doesn't stall the cook. The cook thread keeps using the old one and
+// swaps once take() hands over the finished one.
+class SimulationBuilder {
+public:
+	SimulationBuilder(const vector<shared_ptr<SceneBase>>& scenes);
+	// Waits for a build in progress
+	~SimulationBuilder();
+
+	// Starts building a world for params. If a build is already running it
+	// finishes first and is thrown away, then params are built.
+	void start(const SimulationParameters& params);
+
+	bool isBuilding() const { return _thread.joinable(); }
+
+	// Returns the finished simulation once, NULL while still building
+	unique_ptr<Simulation> take();
+
+private:
+	void run(SimulationParameters params);
+
+	const vector<shared_ptr<SceneBase>>& _scenes;
+
+	thread _thread;
+	atomic<bool> _done{ false };
+	unique_ptr<Simulation> _result;
+
+	SimulationParameters _pendingParams;
+	bool _hasPending = false;
+};
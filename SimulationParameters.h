@@ -0,0 +1,302 @@
+#pragma once
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CPlusPlus_Common.h"
+#include "SimdKernels.h"
+#include "ParticleChannels.h"
+
+struct ColliderGeometry;
+struct KinematicCollider;
+struct ForceField;
+struct Emitter;
+struct KillZone;
+
+// Particle system besides the main one, see ParticleSystemLoader. Only the
+// emitters whose system channel points at it spawn into it, from a pool of
+// its own.
+struct ParticleSystemSettings {
+	float radius;
+	float damping;
+	int iterations;
+	// Particles set aside for its emitters, see EmitterPool
+	int pool;
+};
+
+// True if both lists have the same number of systems with the same pools
+inline bool sameParticleSystemPools(const std::vector<ParticleSystemSettings>* a,
+	const std::vector<ParticleSystemSettings>* b) {
+	size_t n = a ? a->size() : 0;
+	if (n != (b ? b->size() : 0)) {
+		return false;
+	}
+	for (size_t i = 0; i < n; i++) {
+		if ((*a)[i].pool != (*b)[i].pool) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Groups of parameters that are applied to a live world together
+enum ParameterChange : uint32_t {
+	// Scene, particle type, warm start file, emitter pools and the number of
+	// particle systems; the world has to be rebuilt
+	ChangeWorld = 1 << 0,
+	ChangeGravity = 1 << 1,
+	ChangeParticleSize = 1 << 2,
+	ChangeParticleDamping = 1 << 3,
+	// Output length and attributes
+	ChangeCapacity = 1 << 4,
+	// Read while stepping, nothing to apply
+	ChangeStep = 1 << 5,
+	// Collider SOP shape; its fixtures are rebuilt
+	ChangeCollider = 1 << 6,
+	// Collider SOP moved; its body is moved
+	ChangeColliderTransform = 1 << 7,
+	// Kinematic CHOP; bodies are added, removed or resized
+	ChangeKinematic = 1 << 8,
+	ChangeStuckThreshold = 1 << 9,
+	// Radius or damping of the extra particle systems
+	ChangeParticleSystems = 1 << 10,
+};
+
+// Copy of the parameters the simulation reads. It's taken on the cook thread,
+// so the world can be set up and stepped without access to OP_Inputs.
+struct SimulationParameters {
+	int sceneIndex = 0;
+	int particleType = 0;
+	double particleSize = 0.02;
+	double particleDamping = 0.2;
+	double gravityX = 0.0;
+	double gravityY = -9.8;
+	int velocityIterations = 6;
+	int positionIterations = 2;
+	int particleIterations = 1;
+	int fps = 60;
+	int maxSubsteps = 4;
+	// Lowers the iterations and substeps above down to the minimums while
+	// frames take longer than frameBudget milliseconds, see FrameGovernor
+	bool governor = false;
+	double frameBudget = 8.0;
+	int minVelocityIterations = 2;
+	int minPositionIterations = 1;
+	int minParticleIterations = 1;
+	int minSubsteps = 1;
+	// Sizes the substeps from the fastest particle instead of fps, so no
+	// particle moves more than courant diameters per step, within the
+	// bounds in seconds
+	bool adaptiveTimestep = false;
+	double courant = 0.5;
+	double minTimeStep = 0.001;
+	double maxTimeStep = 1.0 / 30;
+	int numThreads = 0;
+	SimdLevel simdLevel = SimdLevel::Auto;
+	bool particleSleep = false;
+	double sleepSkin = 0.01;
+	uint32_t channelMask = AttributePosition;
+	bool fixedCapacity = false;
+	int maxParticles = 10000;
+	bool autoGrow = false;
+	double checkpointInterval = 1.0;
+	int maxCheckpoints = 10;
+	double rewindSeconds = 2.0;
+	// State file setup() starts from, see StateFile.h. Empty for none.
+	std::string warmStartFile;
+	// Scene from the SceneCache to build instead of sceneIndex, 0 for none.
+	// Set by the CHOP's SceneLoader, load() doesn't touch it.
+	uint64_t sceneHash = 0;
+	// Particles set aside for the emitters, see EmitterPool
+	int emitterPool = 0;
+	// Collider from the Collider SOP and where to place it, NULL for none.
+	// Set by the CHOP's ColliderLoader, load() doesn't touch them.
+	std::shared_ptr<const ColliderGeometry> collider;
+	double colliderX = 0.0;
+	double colliderY = 0.0;
+	double colliderAngle = 0.0;
+	// Targets of the kinematic colliders, one body each. Set by the CHOP's
+	// KinematicLoader, load() doesn't touch them.
+	std::shared_ptr<const std::vector<KinematicCollider>> kinematicColliders;
+	// Acceleration field from the Force TOP, scaled by forceScale and laid
+	// over the rectangle at forceCenter. Set by the CHOP's ForceFieldLoader,
+	// load() only reads the placement.
+	std::shared_ptr<const ForceField> forceField;
+	double forceCenterX = 0.0;
+	double forceCenterY = 0.0;
+	double forceSizeX = 4.0;
+	double forceSizeY = 4.0;
+	double forceScale = 1.0;
+	// Set by the CHOP's EmitterLoader, load() doesn't touch them
+	std::shared_ptr<const std::vector<Emitter>> emitters;
+	// Particles inside a kill zone, or outside the bounds while cullOutside
+	// is on, are culled after every step. The zones are set by the CHOP's
+	// KillZoneLoader, load() doesn't touch them.
+	std::shared_ptr<const std::vector<KillZone>> killZones;
+	bool cullOutside = false;
+	double boundsCenterX = 0.0;
+	double boundsCenterY = 0.0;
+	double boundsSizeX = 10.0;
+	double boundsSizeY = 10.0;
+	// Steps a particle may touch several bodies before it counts as stuck
+	// and is culled, 0 for never
+	int stuckThreshold = 0;
+	// Particle systems besides the main one, NULL for none. Set by the
+	// CHOP's ParticleSystemLoader, load() doesn't touch them.
+	std::shared_ptr<const std::vector<ParticleSystemSettings>> particleSystems;
+
+	void load(const OP_Inputs* inputs) {
+		sceneIndex = inputs->getParInt("Sceneindex");
+		particleType = inputs->getParInt("Particletype");
+		particleSize = inputs->getParDouble("Particlesize");
+		particleDamping = inputs->getParDouble("Particledamping");
+		inputs->getParDouble2("Gravity", gravityX, gravityY);
+		velocityIterations = inputs->getParInt("Velocityiterations");
+		positionIterations = inputs->getParInt("Positioniterations");
+		particleIterations = inputs->getParInt("Particleiterations");
+		fps = inputs->getParInt("Fps");
+		maxSubsteps = inputs->getParInt("Maxsubsteps");
+		governor = inputs->getParInt("Governor") != 0;
+		frameBudget = inputs->getParDouble("Framebudget");
+		minVelocityIterations = inputs->getParInt("Minvelocityiterations");
+		minPositionIterations = inputs->getParInt("Minpositioniterations");
+		minParticleIterations = inputs->getParInt("Minparticleiterations");
+		minSubsteps = inputs->getParInt("Minsubsteps");
+		adaptiveTimestep = inputs->getParInt("Adaptivestep") != 0;
+		courant = inputs->getParDouble("Courant");
+		minTimeStep = inputs->getParDouble("Mintimestep") / 1000.0;
+		maxTimeStep = inputs->getParDouble("Maxtimestep") / 1000.0;
+		numThreads = inputs->getParInt("Threads");
+		simdLevel = (SimdLevel)inputs->getParInt("Simd");
+		particleSleep = inputs->getParInt("Particlesleep") != 0;
+		sleepSkin = inputs->getParDouble("Sleepskin");
+		channelMask = 0;
+		for (int i = 0; i < NumParticleAttributes; i++) {
+			const char* parameter = ParticleAttributes[i].parameter;
+			if (parameter && inputs->getParInt(parameter)) {
+				channelMask |= ParticleAttributes[i].attribute;
+			}
+		}
+		fixedCapacity = inputs->getParInt("Fixedcapacity") != 0;
+		maxParticles = inputs->getParInt("Maxparticles");
+		autoGrow = inputs->getParInt("Autogrow") != 0;
+		if (fixedCapacity) {
+			channelMask |= AttributeActive;
+		}
+		checkpointInterval = inputs->getParDouble("Checkpointinterval");
+		maxCheckpoints = inputs->getParInt("Checkpoints");
+		rewindSeconds = inputs->getParDouble("Rewindseconds");
+		const char* path = inputs->getParFilePath("Warmstartfile");
+		warmStartFile = path ? path : "";
+		inputs->getParDouble2("Forcecenter", forceCenterX, forceCenterY);
+		inputs->getParDouble2("Forcesize", forceSizeX, forceSizeY);
+		forceScale = inputs->getParDouble("Forcescale");
+		emitterPool = inputs->getParInt("Emitterpool");
+		cullOutside = inputs->getParInt("Cullbounds") != 0;
+		inputs->getParDouble2("Boundscenter", boundsCenterX, boundsCenterY);
+		inputs->getParDouble2("Boundssize", boundsSizeX, boundsSizeY);
+		stuckThreshold = inputs->getParInt("Stuckthreshold");
+	}
+
+	double getTimeStep() const {
+		return 0 < fps ? 1.0 / fps : 0;
+	}
+
+	// True if both build the same world in Simulation::setup(). Everything
+	// else can be changed on a live world, see diff().
+	bool sameWorld(const SimulationParameters& other) const {
+		return sceneIndex == other.sceneIndex &&
+			particleType == other.particleType &&
+			warmStartFile == other.warmStartFile &&
+			sceneHash == other.sceneHash &&
+			emitterPool == other.emitterPool &&
+			sameParticleSystemPools(particleSystems.get(), other.particleSystems.get());
+	}
+
+	// Returns the ParameterChange groups whose fields differ from other
+	uint32_t diff(const SimulationParameters& other) const {
+		uint32_t changed = 0;
+		if (!sameWorld(other)) {
+			changed |= ChangeWorld;
+		}
+		if (gravityX != other.gravityX || gravityY != other.gravityY) {
+			changed |= ChangeGravity;
+		}
+		if (particleSize != other.particleSize) {
+			changed |= ChangeParticleSize;
+		}
+		if (particleDamping != other.particleDamping) {
+			changed |= ChangeParticleDamping;
+		}
+		if (channelMask != other.channelMask ||
+			fixedCapacity != other.fixedCapacity ||
+			maxParticles != other.maxParticles ||
+			autoGrow != other.autoGrow) {
+			changed |= ChangeCapacity;
+		}
+		if (velocityIterations != other.velocityIterations ||
+			positionIterations != other.positionIterations ||
+			particleIterations != other.particleIterations ||
+			fps != other.fps ||
+			maxSubsteps != other.maxSubsteps ||
+			governor != other.governor ||
+			frameBudget != other.frameBudget ||
+			minVelocityIterations != other.minVelocityIterations ||
+			minPositionIterations != other.minPositionIterations ||
+			minParticleIterations != other.minParticleIterations ||
+			minSubsteps != other.minSubsteps ||
+			adaptiveTimestep != other.adaptiveTimestep ||
+			courant != other.courant ||
+			minTimeStep != other.minTimeStep ||
+			maxTimeStep != other.maxTimeStep ||
+			numThreads != other.numThreads ||
+			simdLevel != other.simdLevel ||
+			particleSleep != other.particleSleep ||
+			sleepSkin != other.sleepSkin ||
+			checkpointInterval != other.checkpointInterval ||
+			maxCheckpoints != other.maxCheckpoints ||
+			rewindSeconds != other.rewindSeconds ||
+			forceField != other.forceField ||
+			forceCenterX != other.forceCenterX ||
+			forceCenterY != other.forceCenterY ||
+			forceSizeX != other.forceSizeX ||
+			forceSizeY != other.forceSizeY ||
+			forceScale != other.forceScale ||
+			emitters != other.emitters ||
+			killZones != other.killZones ||
+			cullOutside != other.cullOutside ||
+			boundsCenterX != other.boundsCenterX ||
+			boundsCenterY != other.boundsCenterY ||
+			boundsSizeX != other.boundsSizeX ||
+			boundsSizeY != other.boundsSizeY) {
+			changed |= ChangeStep;
+		}
+		if (collider != other.collider) {
+			changed |= ChangeCollider;
+		}
+		if (colliderX != other.colliderX ||
+			colliderY != other.colliderY ||
+			colliderAngle != other.colliderAngle) {
+			changed |= ChangeColliderTransform;
+		}
+		if (kinematicColliders != other.kinematicColliders) {
+			changed |= ChangeKinematic;
+		}
+		if (stuckThreshold != other.stuckThreshold) {
+			changed |= ChangeStuckThreshold;
+		}
+		if (particleSystems != other.particleSystems) {
+			changed |= ChangeParticleSystems;
+		}
+		return changed;
+	}
+
+	bool operator==(const SimulationParameters& other) const {
+		return diff(other) == 0;
+	}
+
+	bool operator!=(const SimulationParameters& other) const {
+		return !(*this == other);
+	}
+};
@@ -0,0 +1,161 @@
+#include "SimulationService.h"
+
+#include <algorithm>
+
+#include "SimulationThread.h"
+#include "Stopwatch.h"
+#include "TaskExecutor.h"
+
+static mutex serviceMutex;
+static weak_ptr<SimulationService> service;
+
+shared_ptr<SimulationService> SimulationService::acquire() {
+	lock_guard<mutex> lock(serviceMutex);
+	shared_ptr<SimulationService> current = service.lock();
+	if (!current) {
+		// Leaves a core to the cook thread. A couple of workers step the
+		// worlds and the executor's threads split their passes, so there are
+		// never more threads running than cores.
+		int cores = max(TaskExecutor::getHardwareThreads() - 1, 1);
+		int numWorkers = cores >= 4 ? 2 : 1;
+		current = make_shared<SimulationService>(numWorkers, cores - numWorkers + 1);
+		service = current;
+	}
+	return current;
+}
+
+SimulationService::SimulationService(int numWorkers, int executorThreads) : _executor(max(executorThreads, 1)) {
+	if (numWorkers < 1) {
+		numWorkers = 1;
+	}
+	for (int i = 0; i < numWorkers; i++) {
+		_workers.push_back(thread(&SimulationService::run, this));
+	}
+}
+
+SimulationService::~SimulationService() {
+	{
+		lock_guard<mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+	for (thread& worker : _workers) {
+		worker.join();
+	}
+}
+
+void SimulationService::add(SimulationThread* thread) {
+	lock_guard<mutex> lock(_mutex);
+	Job job;
+	job.thread = thread;
+	_jobs.push_back(job);
+}
+
+void SimulationService::remove(SimulationThread* thread) {
+	unique_lock<mutex> lock(_mutex);
+	_idle.wait(lock, [&] { return !find(thread)->running; });
+	for (size_t i = 0; i < _jobs.size(); i++) {
+		if (_jobs[i].thread == thread) {
+			_jobs.erase(_jobs.begin() + i);
+			break;
+		}
+	}
+}
+
+void SimulationService::setSchedule(SimulationThread* thread, int priority, double quotaMS) {
+	bool ready = false;
+	{
+		lock_guard<mutex> lock(_mutex);
+		Job* job = find(thread);
+		if (job->priority == priority && job->quota == quotaMS) {
+			return;
+		}
+		job->priority = priority;
+		job->quota = quotaMS;
+		job->credit = quotaMS;
+		ready = job->pending;
+	}
+	if (ready) {
+		_wake.notify_one();
+	}
+}
+
+void SimulationService::startCook(SimulationThread* thread) {
+	bool ready = false;
+	{
+		lock_guard<mutex> lock(_mutex);
+		Job* job = find(thread);
+		if (0 < job->quota) {
+			// Unused time isn't saved up for later cooks
+			job->credit = min(job->credit + job->quota, job->quota);
+		}
+		ready = job->pending;
+	}
+	if (ready) {
+		_wake.notify_one();
+	}
+}
+
+void SimulationService::notify(SimulationThread* thread) {
+	{
+		lock_guard<mutex> lock(_mutex);
+		find(thread)->pending = true;
+	}
+	_wake.notify_one();
+}
+
+void SimulationService::run() {
+	unique_lock<mutex> lock(_mutex);
+	while (true) {
+		_wake.wait(lock, [this] { return _quit || findReady() >= 0; });
+		if (_quit) {
+			return;
+		}
+
+		Job& job = _jobs[findReady()];
+		SimulationThread* thread = job.thread;
+		job.pending = false;
+		job.running = true;
+		job.lastRun = ++_runs;
+		lock.unlock();
+
+		Stopwatch stopwatch;
+		thread->processCommands();
+		double time = stopwatch.elapsedMS();
+
+		lock.lock();
+		Job* ran = find(thread);
+		ran->running = false;
+		if (0 < ran->quota) {
+			ran->credit -= time;
+		}
+		_idle.notify_all();
+		if (ran->pending) {
+			_wake.notify_one();
+		}
+	}
+}
+
+int SimulationService::findReady() const {
+	int best = -1;
+	for (int i = 0; i < (int)_jobs.size(); i++) {
+		const Job& job = _jobs[i];
+		if (!job.pending || job.running || (0 < job.quota && job.credit <= 0)) {
+			continue;
+		}
+		if (best < 0 || job.priority > _jobs[best].priority ||
+			(job.priority == _jobs[best].priority && job.lastRun < _jobs[best].lastRun)) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+SimulationService::Job* SimulationService::find(SimulationThread* thread) {
+	for (Job& job : _jobs) {
+		if (job.thread == thread) {
+			return &job;
+		}
+	}
+	return NULL;
+}
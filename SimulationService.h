@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TaskExecutor.h"
+
+using namespace std;
+
+class SimulationThread;
+
+// Runs the SimulationThreads of every CHOP in the process on one bounded
+// pool of workers, instead of a thread each. A SimulationThread runs on one
+// worker at a time. Ready ones are picked by priority, then by whoever ran
+// longest ago, and a CPU quota limits how much worker time one may take per
+// cook, so background worlds can't starve the one that matters. The worlds
+// also share one TaskExecutor for their per-particle passes, so the number
+// of threads doesn't grow with the number of CHOPs. The workers and the
+// executor's threads split the cores between them.
+class SimulationService {
+public:
+	// The service of this process. It's created with the first
+	// SimulationThread and stopped with the last, never while the DLL
+	// unloads.
+	static shared_ptr<SimulationService> acquire();
+
+	// 'executorThreads' counts the worker calling into it, like TaskExecutor
+	SimulationService(int numWorkers, int executorThreads);
+	~SimulationService();
+
+	int getNumWorkers() const { return (int)_workers.size(); }
+	TaskExecutor& getExecutor() { return _executor; }
+
+	void add(SimulationThread* thread);
+	// Waits until no worker runs the thread any more
+	void remove(SimulationThread* thread);
+
+	// Higher priorities run first. Per cook a thread may use 'quotaMS'
+	// milliseconds of worker time, 0 for no limit; a thread over its quota
+	// waits for the next cook, and the time it owes is stepped then.
+	void setSchedule(SimulationThread* thread, int priority, double quotaMS);
+
+	// Called once per cook of the thread's CHOP, whether its commands fit
+	// in the queue or not; tops up its quota
+	void startCook(SimulationThread* thread);
+
+	// Called after a command was posted to the thread
+	void notify(SimulationThread* thread);
+
+private:
+	struct Job {
+		SimulationThread* thread = NULL;
+		int priority = 0;
+		double quota = 0;
+		// Milliseconds left of the quota
+		double credit = 0;
+		bool pending = false;
+		bool running = false;
+		uint64_t lastRun = 0;
+	};
+
+	void run();
+	// Index of the job to run next, -1 if none is ready
+	int findReady() const;
+	Job* find(SimulationThread* thread);
+
+	TaskExecutor _executor;
+	vector<Job> _jobs;
+	uint64_t _runs = 0;
+	bool _quit = false;
+	mutex _mutex;
+	condition_variable _wake;
+	condition_variable _idle;
+	vector<thread> _workers;
+};
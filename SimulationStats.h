@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+
+// Profiling counters of a Simulation, shown in the Info CHOP
+struct SimulationStats {
+	// Milliseconds spent in b2World::Step and the scene's update() during the
+	// last step(), summed over its substeps
+	double stepTime = 0;
+	double updateTime = 0;
+	// Milliseconds the last setup() took
+	double initTime = 0;
+
+	int particles = 0;
+	int contacts = 0;
+	int bodyContacts = 0;
+	size_t bufferBytes = 0;
+	// Substeps that found the particle buffers full, since setup
+	int buffersFull = 0;
+	// Live particles from the emitter pool, and spawns skipped because it
+	// was empty since setup
+	int emitterParticles = 0;
+	int emitterDropped = 0;
+	// Particles culled by kill zones or the bounds, and as stuck, since setup
+	int culledZone = 0;
+	int culledStuck = 0;
+	// Level of the FrameGovernor, 0 at full quality, its averaged frame time
+	// and the solver settings it picked for the last step()
+	int governorLevel = 0;
+	double governorTime = 0;
+	int velocityIterations = 0;
+	int positionIterations = 0;
+	int particleIterations = 0;
+	int maxSubsteps = 0;
+	// Seconds, of the last substep
+	double timeStep = 0;
+};
@@ -0,0 +1,105 @@
+#include "SimulationThread.h"
+
+SimulationThread::SimulationThread(Simulation* simulation) : _simulation(simulation) {
+	// Borrow the shared executor first, so capturing doesn't start a
+	// private one
+	_service = SimulationService::acquire();
+	_simulation->borrowExecutor(&_service->getExecutor());
+
+	// Publish the current state so there's something to output right away
+	capture(_snapshots.back());
+	_snapshots.publish();
+
+	_service->add(this);
+}
+
+SimulationThread::~SimulationThread() {
+	// No worker runs it any more, so the commands still queued run here;
+	// a pulsed Save State, Restart or Rewind isn't lost
+	_service->remove(this);
+	processCommands();
+	_simulation->borrowExecutor(NULL);
+}
+
+bool SimulationThread::post(const SimulationCommand& command) {
+	if (!_commands.push(command)) {
+		return false;
+	}
+	_service->notify(this);
+	return true;
+}
+
+const ParticleSnapshot& SimulationThread::acquire() {
+	_snapshots.update();
+	return _snapshots.front();
+}
+
+void SimulationThread::processCommands() {
+	bool changed = false;
+	int substeps = 0;
+	double stepTime = 0;
+	double updateTime = 0;
+	SimulationCommand command;
+	while (_commands.pop(command)) {
+		switch (command.type) {
+		case SimulationCommand::Type::SetParameters:
+			_simulation->setParameters(command.params);
+			break;
+		case SimulationCommand::Type::Step:
+			substeps += _simulation->step(command.elapsed);
+			stepTime += _simulation->getStats().stepTime;
+			updateTime += _simulation->getStats().updateTime;
+			changed = true;
+			break;
+		case SimulationCommand::Type::Restart:
+			_simulation->restart();
+			changed = true;
+			break;
+		case SimulationCommand::Type::Rewind:
+			_simulation->rewind(command.seconds);
+			changed = true;
+			break;
+		case SimulationCommand::Type::SaveState:
+			_simulation->saveState(_simulation->getParameters().warmStartFile.c_str());
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (changed) {
+		ParticleSnapshot& snapshot = _snapshots.back();
+		capture(snapshot);
+		snapshot.substeps = substeps;
+		snapshot.stats.stepTime = stepTime;
+		snapshot.stats.updateTime = updateTime;
+		_snapshots.publish();
+	}
+}
+
+void SimulationThread::capture(ParticleSnapshot& snapshot) {
+	int n = _simulation->getOutputLength();
+	snapshot.channelMask = _simulation->getParameters().channelMask;
+	snapshot.numParticleSystems = _simulation->getNumParticleSystems();
+	snapshot.channels.resize(_simulation->getNumChannels());
+	vector<float*> channels;
+	for (auto& channel : snapshot.channels) {
+		channel.resize(n);
+		channels.push_back(channel.data());
+	}
+	_simulation->writeChannels(channels.data(), n);
+
+	snapshot.numSamples = n;
+	snapshot.substeps = _simulation->getTimestep().getSubsteps();
+	snapshot.accumulator = _simulation->getTimestep().getAccumulator();
+	snapshot.simdLevel = _simulation->getKernels().level;
+	snapshot.sleeping = _simulation->isSleeping();
+	snapshot.stats = _simulation->getStats();
+
+	snapshot.hasWorldStats = _worldStatsRequested.exchange(false);
+	if (snapshot.hasWorldStats) {
+		_simulation->computeWorldStats(snapshot.worldStats);
+	} else {
+		snapshot.worldStats.clear();
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "Simulation.h"
+#include "SimulationService.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+using namespace std;
+
+struct SimulationCommand {
+	enum class Type {
+		None,
+		SetParameters,
+		Step,
+		Restart,
+		Rewind,
+		SaveState,
+	};
+
+	Type type = Type::None;
+	SimulationParameters params;
+	double elapsed = 0;
+	// How far Rewind jumps back
+	double seconds = 0;
+};
+
+// What the CHOP outputs for one simulated frame
+struct ParticleSnapshot {
+	int numSamples = 0;
+	int substeps = 0;
+	double accumulator = 0;
+	SimdLevel simdLevel = SimdLevel::Scalar;
+	bool sleeping = false;
+	uint32_t channelMask = 0;
+	int numParticleSystems = 1;
+	SimulationStats stats;
+	// Only filled in frames captured after requestWorldStats()
+	bool hasWorldStats = false;
+	vector<WorldStatsRow> worldStats;
+	vector<vector<float>> channels;
+};
+
+// Steps a Simulation on the workers of the SimulationService. The cook
+// thread sends commands through a lock-free queue and reads back the newest
+// published snapshot, so while frame N is being output a worker is already
+// stepping N+1, alongside the worlds of the other CHOPs.
+// The Simulation must not be touched by anyone else while this exists.
+class SimulationThread {
+public:
+	SimulationThread(Simulation* simulation);
+	~SimulationThread();
+
+	// Cook thread. Returns false if the queue is full.
+	bool post(const SimulationCommand& command);
+
+	// Cook thread. See SimulationService::setSchedule().
+	void setSchedule(int priority, double quotaMS) { _service->setSchedule(this, priority, quotaMS); }
+	// Cook thread. Call once per cook, before posting.
+	void startCook() { _service->startCook(this); }
+
+	// Cook thread. Picks up the newest snapshot; it stays valid until the
+	// next call.
+	const ParticleSnapshot& acquire();
+
+	// Cook thread. Asks for the world stats in the next captured frame.
+	void requestWorldStats() { _worldStatsRequested = true; }
+
+	// Service worker. Runs the queued commands and publishes a snapshot if
+	// they changed the world.
+	void processCommands();
+
+private:
+	void capture(ParticleSnapshot& snapshot);
+
+	Simulation* _simulation;
+
+	SpscQueue<SimulationCommand, 64> _commands;
+	TripleBuffer<ParticleSnapshot> _snapshots;
+	atomic<bool> _worldStatsRequested{ false };
+
+	shared_ptr<SimulationService> _service;
+};
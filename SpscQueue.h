@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+
+// Lock-free ring buffer for one producer thread and one consumer thread.
+// Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Producer side. Returns false if the queue is full.
+	bool push(const T& item) {
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail - _head.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		_items[tail & (Capacity - 1)] = item;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false if the queue is empty.
+	bool pop(T& item) {
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		T& slot = _items[head & (Capacity - 1)];
+		item = slot;
+		slot = T();
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const {
+		return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+	}
+
+private:
+	T _items[Capacity];
+	std::atomic<size_t> _head{ 0 };
+	std::atomic<size_t> _tail{ 0 };
+};
@@ -0,0 +1,169 @@
+#include "StateFile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+
+#include "MappedFile.h"
+
+// Moves 'from' over 'to', replacing it
+static bool replaceFile(const char* from, const char* to) {
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+static void fillHeader(StateFileHeader& header, const WorldCheckpoint& checkpoint, const SimulationParameters& params) {
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, StateFileMagic, sizeof(header.magic));
+	header.version = StateFileVersion;
+	header.headerSize = sizeof(StateFileHeader);
+	header.sceneIndex = params.sceneIndex;
+	header.particleType = params.particleType;
+	header.sceneHash = params.sceneHash;
+	header.particleSize = params.particleSize;
+	header.particleDamping = params.particleDamping;
+	header.gravityX = params.gravityX;
+	header.gravityY = params.gravityY;
+	header.time = checkpoint.time;
+	header.particleCount = checkpoint.getParticleCount();
+	header.groupCount = (int32_t)checkpoint.groupRanges.size() / 2;
+	header.bodyCount = (int32_t)checkpoint.bodies.size();
+	header.sceneStateSize = (int32_t)checkpoint.sceneState.size();
+}
+
+static size_t getFileSize(const StateFileHeader& header) {
+	return sizeof(StateFileHeader) +
+		(size_t)header.particleCount * (4 * sizeof(float) + sizeof(uint32_t)) +
+		(size_t)header.groupCount * 2 * sizeof(int32_t) +
+		(size_t)header.bodyCount * sizeof(StateFileBody) +
+		(size_t)header.sceneStateSize;
+}
+
+bool writeStateFile(const char* path, const WorldCheckpoint& checkpoint, const SimulationParameters& params) {
+	// Written next to it first, so a failed save leaves the last good file
+	std::string temporary = std::string(path) + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+
+	StateFileHeader header;
+	fillHeader(header, checkpoint, params);
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	// Particles go out as separate arrays, one component at a time
+	int n = header.particleCount;
+	vector<float> component(n);
+	for (int c = 0; c < 4 && ok; c++) {
+		const vector<b2Vec2>& source = c < 2 ? checkpoint.positions : checkpoint.velocities;
+		for (int i = 0; i < n; i++) {
+			component[i] = c % 2 == 0 ? source[i].x : source[i].y;
+		}
+		ok = fwrite(component.data(), sizeof(float), n, file) == (size_t)n;
+	}
+	if (ok) {
+		ok = fwrite(checkpoint.flags.data(), sizeof(uint32_t), n, file) == (size_t)n;
+	}
+	if (ok) {
+		size_t count = checkpoint.groupRanges.size();
+		ok = fwrite(checkpoint.groupRanges.data(), sizeof(int32_t), count, file) == count;
+	}
+	for (size_t i = 0; i < checkpoint.bodies.size() && ok; i++) {
+		const BodyState& state = checkpoint.bodies[i];
+		StateFileBody body;
+		body.x = state.position.x;
+		body.y = state.position.y;
+		body.angle = state.angle;
+		body.vx = state.linearVelocity.x;
+		body.vy = state.linearVelocity.y;
+		body.angularVelocity = state.angularVelocity;
+		body.awake = state.awake ? 1 : 0;
+		ok = fwrite(&body, sizeof(body), 1, file) == 1;
+	}
+	if (ok) {
+		size_t size = checkpoint.sceneState.size();
+		ok = fwrite(checkpoint.sceneState.data(), 1, size, file) == size;
+	}
+
+	if (ok && fflush(file) != 0) {
+		ok = false;
+	}
+	if (fclose(file) != 0) {
+		ok = false;
+	}
+	if (ok) {
+		ok = replaceFile(temporary.c_str(), path);
+	}
+	if (!ok) {
+		remove(temporary.c_str());
+	}
+	return ok;
+}
+
+bool readStateFile(const char* path, const SimulationParameters& params, WorldCheckpoint& checkpoint) {
+	MappedFile file;
+	if (!file.open(path) || file.size() < sizeof(StateFileHeader)) {
+		return false;
+	}
+
+	StateFileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, StateFileMagic, sizeof(header.magic)) != 0 ||
+		header.version != StateFileVersion ||
+		header.headerSize != sizeof(StateFileHeader) ||
+		header.particleCount < 0 || header.groupCount < 0 ||
+		header.bodyCount < 0 || header.sceneStateSize < 0 ||
+		file.size() < getFileSize(header)) {
+		return false;
+	}
+	if (header.sceneIndex != params.sceneIndex ||
+		header.particleType != params.particleType ||
+		header.sceneHash != params.sceneHash) {
+		return false;
+	}
+
+	int n = header.particleCount;
+	const uint8_t* p = file.data() + sizeof(StateFileHeader);
+	const float* components[4];
+	for (int c = 0; c < 4; c++) {
+		components[c] = (const float*)p;
+		p += n * sizeof(float);
+	}
+	checkpoint.time = header.time;
+	checkpoint.radius = (float32)header.particleSize;
+	checkpoint.positions.resize(n);
+	checkpoint.velocities.resize(n);
+	for (int i = 0; i < n; i++) {
+		checkpoint.positions[i].Set(components[0][i], components[1][i]);
+		checkpoint.velocities[i].Set(components[2][i], components[3][i]);
+	}
+	const uint32_t* flags = (const uint32_t*)p;
+	checkpoint.flags.assign(flags, flags + n);
+	p += n * sizeof(uint32_t);
+
+	const int32_t* ranges = (const int32_t*)p;
+	checkpoint.groupRanges.assign(ranges, ranges + 2 * header.groupCount);
+	p += 2 * header.groupCount * sizeof(int32_t);
+
+	checkpoint.bodies.resize(header.bodyCount);
+	for (int i = 0; i < header.bodyCount; i++, p += sizeof(StateFileBody)) {
+		StateFileBody body;
+		memcpy(&body, p, sizeof(body));
+		BodyState& state = checkpoint.bodies[i];
+		state.position.Set(body.x, body.y);
+		state.angle = body.angle;
+		state.linearVelocity.Set(body.vx, body.vy);
+		state.angularVelocity = body.angularVelocity;
+		state.awake = body.awake != 0;
+	}
+
+	checkpoint.sceneState.assign((const char*)p, (const char*)p + header.sceneStateSize);
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+
+#include "SimulationParameters.h"
+#include "WorldCheckpoint.h"
+
+// Binary file holding one WorldCheckpoint, to start a scene from a state that
+// has already settled. Layout, all little endian:
+//   StateFileHeader
+//   float   position x[particleCount], position y[particleCount]
+//   float   velocity x[particleCount], velocity y[particleCount]
+//   uint32  flags[particleCount]
+//   int32   group ranges[2 * groupCount]    buffer index, particle count
+//   StateFileBody bodies[bodyCount]
+//   char    scene state[sceneStateSize]
+// The header records the parameters the world was built with. A file is only
+// used for the same scene and particle type; the positions are rescaled if
+// the particle size differs.
+static const char StateFileMagic[4] = { 'L', 'F', 'S', 'T' };
+static const uint32_t StateFileVersion = 2;
+
+struct StateFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t headerSize;
+
+	int32_t sceneIndex;
+	int32_t particleType;
+	uint64_t sceneHash;
+	double particleSize;
+	double particleDamping;
+	double gravityX;
+	double gravityY;
+
+	double time;
+	int32_t particleCount;
+	int32_t groupCount;
+	int32_t bodyCount;
+	int32_t sceneStateSize;
+};
+
+struct StateFileBody {
+	float x;
+	float y;
+	float angle;
+	float vx;
+	float vy;
+	float angularVelocity;
+	uint32_t awake;
+};
+
+bool writeStateFile(const char* path, const WorldCheckpoint& checkpoint, const SimulationParameters& params);
+
+// Maps the file and decodes it into 'checkpoint'. Returns false if it can't
+// be read, is damaged, or was saved from a different world.
+bool readStateFile(const char* path, const SimulationParameters& params, WorldCheckpoint& checkpoint);
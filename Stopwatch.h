@@ -0,0 +1,18 @@
+#pragma once
+#include <chrono>
+
+// Wall clock timer for the profiling counters
+class Stopwatch {
+public:
+	Stopwatch() : _start(std::chrono::steady_clock::now()) {}
+
+	void restart() { _start = std::chrono::steady_clock::now(); }
+
+	// Milliseconds since construction or the last restart()
+	double elapsedMS() const {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point _start;
+};
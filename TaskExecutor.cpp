@@ -0,0 +1,149 @@
+#include "TaskExecutor.h"
+
+namespace {
+	// Queue index of the current thread in the executor it works for
+	thread_local const void* currentExecutor = NULL;
+	thread_local int currentQueue = 0;
+}
+
+TaskExecutor::TaskExecutor(int numThreads) {
+	if (numThreads <= 0) {
+		numThreads = getHardwareThreads();
+	}
+
+	for (int i = 0; i < numThreads; i++) {
+		_queues.push_back(unique_ptr<Queue>(new Queue()));
+	}
+	for (int i = 1; i < numThreads; i++) {
+		_workers.push_back(thread(&TaskExecutor::run, this, i));
+	}
+}
+
+TaskExecutor::~TaskExecutor() {
+	{
+		lock_guard<mutex> lock(_wakeMutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+	for (auto& worker : _workers) {
+		worker.join();
+	}
+}
+
+int TaskExecutor::getHardwareThreads() {
+	int n = (int)thread::hardware_concurrency();
+	return 0 < n ? n : 1;
+}
+
+void TaskExecutor::parallelFor(int count, int grain, const function<void(int, int, int)>& fn) {
+	if (grain < 1) {
+		grain = 1;
+	}
+	int numChunks = getNumChunks(count, grain);
+	if (numChunks == 0) {
+		return;
+	}
+	if (numChunks == 1 || _workers.empty()) {
+		for (int chunk = 0; chunk < numChunks; chunk++) {
+			int begin = chunk * grain;
+			int end = begin + grain < count ? begin + grain : count;
+			fn(chunk, begin, end);
+		}
+		return;
+	}
+
+	int self = currentExecutor == this ? currentQueue : 0;
+
+	// Deal the chunks out to all queues, the other threads steal from there
+	atomic<int> remaining(numChunks);
+	for (int chunk = 0; chunk < numChunks; chunk++) {
+		Task task;
+		task.fn = &fn;
+		task.chunk = chunk;
+		task.begin = chunk * grain;
+		task.end = task.begin + grain < count ? task.begin + grain : count;
+		task.remaining = &remaining;
+
+		Queue& queue = *_queues[(self + chunk) % _queues.size()];
+		lock_guard<mutex> lock(queue.lock);
+		queue.tasks.push_back(task);
+	}
+	_pending += numChunks;
+	{
+		lock_guard<mutex> lock(_wakeMutex);
+	}
+	_wake.notify_all();
+	_done.notify_all();
+
+	// Help out until our chunks are done
+	while (remaining.load(memory_order_acquire) > 0) {
+		if (runOne(self)) {
+			continue;
+		}
+		// Our last chunks run elsewhere; sleep instead of spinning, so a
+		// caller doesn't take a core from the threads running them
+		unique_lock<mutex> lock(_wakeMutex);
+		_done.wait(lock, [&] { return remaining.load(memory_order_acquire) == 0 || 0 < _pending.load(); });
+	}
+}
+
+void TaskExecutor::run(int index) {
+	currentExecutor = this;
+	currentQueue = index;
+
+	while (true) {
+		if (runOne(index)) {
+			continue;
+		}
+
+		unique_lock<mutex> lock(_wakeMutex);
+		_wake.wait(lock, [this] { return _quit || 0 < _pending.load(); });
+		if (_quit) {
+			return;
+		}
+	}
+}
+
+bool TaskExecutor::runOne(int index) {
+	Task task;
+	if (!popLocal(index, task) && !steal(index, task)) {
+		return false;
+	}
+	_pending--;
+
+	(*task.fn)(task.chunk, task.begin, task.end);
+	if (task.remaining->fetch_sub(1, memory_order_acq_rel) == 1) {
+		// The caller may be asleep waiting for this one. It may also return
+		// right away, so 'remaining' isn't touched after this.
+		{
+			lock_guard<mutex> lock(_wakeMutex);
+		}
+		_done.notify_all();
+	}
+	return true;
+}
+
+bool TaskExecutor::popLocal(int index, Task& task) {
+	Queue& queue = *_queues[index];
+	lock_guard<mutex> lock(queue.lock);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+	task = queue.tasks.back();
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool TaskExecutor::steal(int index, Task& task) {
+	int n = (int)_queues.size();
+	for (int i = 1; i < n; i++) {
+		Queue& queue = *_queues[(index + i) % n];
+		lock_guard<mutex> lock(queue.lock);
+		if (!queue.tasks.empty()) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
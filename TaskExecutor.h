@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Small work-stealing thread pool for the plugin's own per-particle passes.
+// The solver stages inside b2World::Step belong to LiquidFun and still run
+// on the calling thread.
+// Work is split into fixed size chunks whose boundaries only depend on the
+// item count and the grain size, never on the number of threads, so passes
+// that write per-chunk results produce the same output with any thread count.
+// A thread waiting for its work to finish runs pending chunks itself, so
+// parallelFor() may be called from inside a chunk, and sleeps while there's
+// nothing left for it to take.
+class TaskExecutor {
+public:
+	// 'numThreads' includes the calling thread; 0 uses all hardware threads
+	TaskExecutor(int numThreads);
+	~TaskExecutor();
+
+	int getNumThreads() const { return (int)_workers.size() + 1; }
+
+	// Calls fn(chunkIndex, begin, end) for every chunk of [0, count)
+	void parallelFor(int count, int grain, const function<void(int, int, int)>& fn);
+
+	// Maps every chunk to a partial result and combines the partials in chunk
+	// order, so floating point results don't depend on the thread count.
+	template <typename T, typename Map, typename Combine>
+	T parallelReduce(int count, int grain, T identity, Map map, Combine combine) {
+		if (grain < 1) {
+			grain = 1;
+		}
+		int numChunks = getNumChunks(count, grain);
+		vector<T> partials(numChunks, identity);
+		parallelFor(count, grain, [&](int chunk, int begin, int end) {
+			partials[chunk] = map(begin, end);
+		});
+		T result = identity;
+		for (int i = 0; i < numChunks; i++) {
+			result = combine(result, partials[i]);
+		}
+		return result;
+	}
+
+	static int getNumChunks(int count, int grain) {
+		return 0 < count ? (count + grain - 1) / grain : 0;
+	}
+
+	static int getHardwareThreads();
+
+private:
+	struct Task {
+		const function<void(int, int, int)>* fn = NULL;
+		int chunk = 0;
+		int begin = 0;
+		int end = 0;
+		atomic<int>* remaining = NULL;
+	};
+
+	struct Queue {
+		mutex lock;
+		deque<Task> tasks;
+	};
+
+	void run(int index);
+	bool runOne(int index);
+	bool popLocal(int index, Task& task);
+	bool steal(int index, Task& task);
+
+	// Queue 0 belongs to threads outside the pool, 1..n to the workers
+	vector<unique_ptr<Queue>> _queues;
+	vector<thread> _workers;
+
+	atomic<int> _pending{ 0 };
+	atomic<bool> _quit{ false };
+	mutex _wakeMutex;
+	// Workers wait on _wake for new chunks, callers of parallelFor() on
+	// _done for theirs to finish or new chunks to help with
+	condition_variable _wake;
+	condition_variable _done;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+
+// Lock-free triple buffer. The writer fills back() and publishes it, the
+// reader picks up the newest published buffer with update() and reads it via
+// front(). Neither side ever waits for the other.
+template <typename T>
+class TripleBuffer {
+public:
+	// Writer side
+	T& back() { return _buffers[_back]; }
+
+	void publish() {
+		int previous = _middle.exchange(_back | DirtyBit, std::memory_order_acq_rel);
+		_back = previous & IndexMask;
+	}
+
+	// Reader side. Returns true if a newer buffer was published since the
+	// last call.
+	bool update() {
+		if (!(_middle.load(std::memory_order_relaxed) & DirtyBit)) {
+			return false;
+		}
+		int previous = _middle.exchange(_front, std::memory_order_acq_rel);
+		_front = previous & IndexMask;
+		return true;
+	}
+
+	const T& front() const { return _buffers[_front]; }
+
+private:
+	static const int IndexMask = 3;
+	static const int DirtyBit = 4;
+
+	T _buffers[3];
+	int _front = 0;
+	int _back = 1;
+	std::atomic<int> _middle{ 2 };
+};
@@ -1,9 +1,15 @@
 #pragma once
+#include <string.h>
+
 #include "SceneBase.h"
 
 class WaveMachine : public SceneBase {
 public:
-	virtual void setup(b2World* world, b2ParticleSystem* particleSystem, const OP_Inputs* inputs) override {
+	virtual std::shared_ptr<SceneBase> create() const override {
+		return std::make_shared<WaveMachine>();
+	}
+
+	virtual void setup(b2World* world, b2ParticleSystem* particleSystem, const SimulationParameters& params) override {
 		b2Body* ground = NULL;
 		{
 			b2BodyDef bd;
@@ -57,6 +63,18 @@ public:
 		_joint->SetMotorSpeed(0.05f * cosf(_time) * b2_pi);
 	}
 
+	virtual void saveState(std::vector<char>& state) const override {
+		state.resize(sizeof(_time));
+		memcpy(state.data(), &_time, sizeof(_time));
+	}
+
+	virtual void restoreState(const std::vector<char>& state) override {
+		if (state.size() == sizeof(_time)) {
+			memcpy(&_time, state.data(), sizeof(_time));
+			_joint->SetMotorSpeed(0.05f * cosf(_time) * b2_pi);
+		}
+	}
+
 private:
 	b2RevoluteJoint* _joint;
 	float32 _time;
@@ -0,0 +1,100 @@
+#pragma once
+#include <vector>
+
+#include "Box2D/Box2D.h"
+
+using namespace std;
+
+struct BodyState {
+	b2Vec2 position;
+	float32 angle;
+	b2Vec2 linearVelocity;
+	float32 angularVelocity;
+	bool awake;
+};
+
+// Copy of the state that changes while a world is stepped: particles, body
+// transforms and velocities, and the scene's own state. It can only be put
+// back into the world it was taken from, see Simulation::restoreCheckpoint.
+struct WorldCheckpoint {
+	// Simulated seconds since setup
+	double time = 0;
+	// Particle radius the positions are packed for
+	float32 radius = 0;
+
+	vector<b2Vec2> positions;
+	vector<b2Vec2> velocities;
+	vector<uint32> flags;
+	// Buffer range of every group, to check the layout still matches
+	vector<int32> groupRanges;
+
+	vector<BodyState> bodies;
+	vector<char> sceneState;
+	vector<char> emitterState;
+
+	int getParticleCount() const { return (int)positions.size(); }
+};
+
+// The last few periodic checkpoints. The slots are reused, so once the ring
+// is full taking a checkpoint doesn't allocate.
+class CheckpointRing {
+public:
+	void clear() {
+		_first = 0;
+		_count = 0;
+	}
+
+	void setCapacity(int capacity) {
+		if (capacity < 0) {
+			capacity = 0;
+		}
+		if (capacity != (int)_slots.size()) {
+			_slots.resize(capacity);
+			clear();
+		}
+	}
+
+	int getCapacity() const { return (int)_slots.size(); }
+	int size() const { return _count; }
+
+	// Slot for a new checkpoint, overwriting the oldest one if full
+	WorldCheckpoint* push() {
+		if (_slots.empty()) {
+			return NULL;
+		}
+		if (_count == (int)_slots.size()) {
+			_first = (_first + 1) % _slots.size();
+			_count--;
+		}
+		WorldCheckpoint* slot = &_slots[(_first + _count) % _slots.size()];
+		_count++;
+		return slot;
+	}
+
+	// i = 0 is the oldest
+	const WorldCheckpoint& at(int i) const { return _slots[(_first + i) % _slots.size()]; }
+
+	// Newest checkpoint taken at or before 'time', NULL if there is none
+	const WorldCheckpoint* findAtOrBefore(double time) const {
+		for (int i = _count - 1; 0 <= i; i--) {
+			if (at(i).time <= time) {
+				return &at(i);
+			}
+		}
+		return NULL;
+	}
+
+	// Forgets the checkpoints taken after 'time'
+	void dropAfter(double time) {
+		while (0 < _count && at(_count - 1).time > time) {
+			_count--;
+		}
+	}
+
+	double getNewestTime() const { return 0 < _count ? at(_count - 1).time : 0; }
+
+private:
+	vector<WorldCheckpoint> _slots;
+	int _first = 0;
+	int _count = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// One row of the Info DAT: a particle group, the particles outside any
+// group, or a body
+struct WorldStatsRow {
+	enum class Kind {
+		Group,
+		Ungrouped,
+		Body,
+	};
+
+	Kind kind = Kind::Group;
+	// Particle system of a group, 0 for the main one and 1 and up for the
+	// ones from the Systems CHOP
+	int system = 0;
+	// Position in the group or body list
+	int index = 0;
+	// Particles in the group, or particle contacts with the body
+	int particles = 0;
+	float centroidX = 0;
+	float centroidY = 0;
+	float minX = 0;
+	float minY = 0;
+	float maxX = 0;
+	float maxY = 0;
+	float meanSpeed = 0;
+	float maxSpeed = 0;
+	// Group flags, or the body type
+	uint32_t flags = 0;
+	// Per-particle buffer memory the group occupies, 0 for bodies
+	size_t bytes = 0;
+};
+
+static const char* const WorldStatsColumns[] = {
+	"name", "particles", "centroid_x", "centroid_y",
+	"aabb_min_x", "aabb_min_y", "aabb_max_x", "aabb_max_y",
+	"mean_speed", "max_speed", "flags", "bytes",
+};
+
+static const int NumWorldStatsColumns = sizeof(WorldStatsColumns) / sizeof(WorldStatsColumns[0]);